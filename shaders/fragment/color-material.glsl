@@ -1,12 +1,5 @@
 #version 410
 
-struct Material {
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-	float shininess;
-};
-
 struct DirLight {
 	vec3 dir;
 	vec3 ambient;
@@ -21,14 +14,53 @@ out vec4 FragColor;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform Material material;
-uniform mat4 view;
+layout(std140) uniform Material {
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float shininess;
+} material;
 
 #define MAX_DIR_LIGHTS 10
-uniform DirLight dirLights[MAX_DIR_LIGHTS];
-uniform uint numDirLights;
+layout(std140) uniform DirLights {
+	DirLight dirLights[MAX_DIR_LIGHTS];
+	uint numDirLights;
+};
 
-vec3 calcDirLight(DirLight light, vec3 viewDir, vec3 normal);
+// cast by dirLights[0]
+#define SHADOW_CASCADES 4
+layout(std140) uniform Shadows {
+	mat4 shadowCascades[SHADOW_CASCADES];
+	vec4 shadowSplits;
+	vec4 shadowNormalOffsets;
+	uint numShadowCascades;
+};
+
+uniform sampler2DArrayShadow shadowMap;
+
+layout(std140) uniform Camera {
+	mat4 view;
+	mat4 proj;
+	mat4 viewProj;
+};
+
+// the point and spot lights, 4 texels each, and their lists per froxel
+layout(std140) uniform Clusters {
+	// the froxels in x, y and z, the number of lights in w
+	uvec4 clusterDims;
+	// the slice of a depth d is floor(log(d) * x + y)
+	vec4 clusterSlices;
+};
+
+uniform samplerBuffer lightData;
+// the offset and the count of every froxel's list
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer lightIndices;
+
+vec3 calcDirLight(DirLight light, vec3 viewDir, vec3 normal, float shadow);
+float calcShadow(vec3 normal);
+vec3 calcLocalLights(vec3 viewDir, vec3 normal);
+vec3 calcLocalLight(uint index, vec3 viewDir, vec3 normal);
 
 void main() {
 	vec3 norm = normalize(Normal);
@@ -37,16 +69,17 @@ void main() {
 	vec3 result = vec3(0.0);
 
 	for (uint i = 0; i < numDirLights; i++) {
-		result += calcDirLight(dirLights[i], viewDir, norm);
+		result += calcDirLight(dirLights[i], viewDir, norm, i == 0 ? calcShadow(norm) : 1.0);
 	}
+	result += calcLocalLights(viewDir, norm);
 	
 	FragColor = vec4(result, 1.0);
 	//NormalColor = vec4(norm * 0.5 + 0.5, 1.0);
 }
 
-vec3 calcDirLight(DirLight light, vec3 viewDir, vec3 normal) {
-	// convert light direction to view space
-	vec3 lightDir = normalize(-(view * vec4(light.dir, 0.0)).xyz);
+vec3 calcDirLight(DirLight light, vec3 viewDir, vec3 normal, float shadow) {
+	// the direction is already in view space
+	vec3 lightDir = normalize(-light.dir);
 	
 	// calculate diffuse intensity
 	float diff = dot(normal, lightDir) * 0.5 + 0.5;
@@ -60,5 +93,80 @@ vec3 calcDirLight(DirLight light, vec3 viewDir, vec3 normal) {
 	vec3 diffuse = light.diffuse * diff * material.diffuse;
 	vec3 specular = light.specular * spec * material.specular;
 
-	return ambient + diffuse + specular;
+	return ambient + (diffuse + specular) * shadow;
+}
+
+// 1 where the light reaches the fragment, 0 in the shadow
+float calcShadow(vec3 normal) {
+	float depth = -FragPos.z;
+
+	uint cascade = 0;
+	while (cascade < numShadowCascades && depth > shadowSplits[cascade]) cascade++;
+	if (cascade >= numShadowCascades) return 1.0;
+
+	// moved along the normal, so the surface doesn't shadow itself
+	vec3 pos = FragPos + normal * shadowNormalOffsets[cascade];
+	vec4 coords = shadowCascades[cascade] * vec4(pos, 1.0);
+
+	// the 4 taps are compared and filtered 2x2 each
+	vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+	float lit = 0.0;
+	for (int x = 0; x < 2; x++) {
+		for (int y = 0; y < 2; y++) {
+			vec2 offset = (vec2(x, y) - 0.5) * texel;
+			lit += texture(shadowMap, vec4(coords.xy + offset, float(cascade), coords.z));
+		}
+	}
+
+	return lit / 4.0;
+}
+
+// only the lights of the fragment's froxel
+vec3 calcLocalLights(vec3 viewDir, vec3 normal) {
+	if (clusterDims.w == 0u) return vec3(0.0);
+
+	vec4 clip = proj * vec4(FragPos, 1.0);
+	vec2 tile = clamp((clip.xy / clip.w * 0.5 + 0.5) * vec2(clusterDims.xy), vec2(0.0), vec2(clusterDims.xy) - 1.0);
+	float slice = clamp(floor(log(-FragPos.z) * clusterSlices.x + clusterSlices.y), 0.0, float(clusterDims.z) - 1.0);
+
+	uint cluster = (uint(slice) * clusterDims.y + uint(tile.y)) * clusterDims.x + uint(tile.x);
+	uvec2 list = texelFetch(clusterGrid, int(cluster)).xy;
+
+	vec3 result = vec3(0.0);
+	for (uint i = 0u; i < list.y; i++) {
+		result += calcLocalLight(texelFetch(lightIndices, int(list.x + i)).r, viewDir, normal);
+	}
+	return result;
+}
+
+vec3 calcLocalLight(uint index, vec3 viewDir, vec3 normal) {
+	int texel = int(index) * 4;
+	vec4 positionRange = texelFetch(lightData, texel);
+	vec4 colorAmbient = texelFetch(lightData, texel + 1);
+	vec4 directionCosOuter = texelFetch(lightData, texel + 2);
+	vec4 params = texelFetch(lightData, texel + 3);
+
+	vec3 toLight = positionRange.xyz - FragPos;
+	float dist = length(toLight);
+	if (dist >= positionRange.w) return vec3(0.0);
+	vec3 lightDir = toLight / dist;
+
+	// falls off with the squared distance and smoothly to 0 at the range
+	float ratio = dist / positionRange.w;
+	float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+	float attenuation = window * window / (1.0 + dist * dist);
+
+	// point lights have an outer cosine below -1, so every direction is inside
+	float cone = smoothstep(directionCosOuter.w, params.z, dot(-lightDir, directionCosOuter.xyz));
+
+	float diff = max(dot(normal, lightDir), 0.0);
+	vec3 reflectDir = reflect(-lightDir, normal);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+
+	vec3 color = colorAmbient.rgb;
+	vec3 ambient = color * colorAmbient.w * material.ambient;
+	vec3 diffuse = color * params.x * diff * material.diffuse;
+	vec3 specular = color * params.y * spec * material.specular;
+
+	return (ambient + (diffuse + specular) * cone) * attenuation;
 }
\ No newline at end of file
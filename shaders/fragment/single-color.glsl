@@ -1,12 +1,5 @@
 #version 410
 
-struct Material {
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-	float shininess;
-};
-
 out vec4 FragColor;
 //layout(location = 0) out vec4 FragColor;
 //layout(location = 1) out vec4 NormalColor;
@@ -14,7 +7,12 @@ out vec4 FragColor;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform Material material;
+layout(std140) uniform Material {
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+	float shininess;
+} material;
 
 void main() {
 	FragColor = vec4(material.diffuse, 1.0);
@@ -0,0 +1,27 @@
+#version 410 core
+
+
+layout(location = 0) in vec4 aPos;
+layout(location = 1) in vec3 aNormal;
+// per instance, a mat4x3 takes a location per column
+layout(location = 3) in mat4x3 aModel;
+layout(location = 7) in mat3 aNormalMat;
+
+out vec3 Normal;
+out vec3 FragPos;
+
+layout(std140) uniform Camera {
+	mat4 view;
+	mat4 proj;
+	mat4 viewProj;
+};
+
+
+void main() {
+	vec4 tempInViewSpace = view * vec4(aModel * aPos, 1.0);
+
+	FragPos = tempInViewSpace.xyz;
+	gl_Position = proj * tempInViewSpace;
+	// the normal matrix is in world space and the view has no scale
+	Normal = mat3(view) * (aNormalMat * aNormal);
+}
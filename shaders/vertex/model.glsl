@@ -5,19 +5,26 @@ layout(location = 0) in vec4 aPos;
 layout(location = 1) in vec3 aNormal;
 
 out vec3 Normal;
-//out vec3 FragPos;
+out vec3 FragPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 proj;
-uniform mat3 normal;
+layout(std140) uniform Camera {
+	mat4 view;
+	mat4 proj;
+	mat4 viewProj;
+};
+
+layout(std140) uniform Object {
+	mat4x3 model;
+	mat3 normal;
+};
 
 
 void main() {
-	vec4 tempInViewSpace = view * model * aPos;
+	vec4 tempInViewSpace = view * vec4(model * aPos, 1.0);
 
-	//FragPos = tempInViewSpace.xyz;
+	FragPos = tempInViewSpace.xyz;
 	gl_Position = proj * tempInViewSpace;
-	Normal = normal * aNormal;
+	// the normal matrix is in world space and the view has no scale
+	Normal = mat3(view) * (normal * aNormal);
 }
 
@@ -0,0 +1,13 @@
+#version 410 core
+
+
+layout(location = 0) in vec3 aPos;
+// per instance, a mat4x3 takes a location per column
+layout(location = 3) in mat4x3 aModel;
+
+uniform mat4 lightViewProj;
+
+
+void main() {
+	gl_Position = lightViewProj * vec4(aModel * vec4(aPos, 1.0), 1.0);
+}
@@ -0,0 +1,318 @@
+#include "aabbTree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+
+AabbTree::AabbTree()
+	: root(AABB_TREE_NULL)
+	, freeList(AABB_TREE_NULL)
+	, leafCount(0)
+{}
+
+int32_t AabbTree::allocateNode() {
+	int32_t index;
+
+	if (freeList == AABB_TREE_NULL) {
+		nodes.push_back({});
+		index = static_cast<int32_t>(nodes.size() - 1);
+	}
+	else {
+		index = freeList;
+		freeList = nodes[index].parent;
+	}
+
+	node& n = nodes[index];
+	n.parent = AABB_TREE_NULL;
+	n.child1 = AABB_TREE_NULL;
+	n.child2 = AABB_TREE_NULL;
+	n.height = 0;
+	n.userData = 0;
+	return index;
+}
+
+void AabbTree::freeNode(int32_t index) {
+	nodes[index].parent = freeList;
+	nodes[index].height = -1;
+	freeList = index;
+}
+
+int32_t AabbTree::findBestSibling(const aabb& box) const {
+	int32_t index = root;
+
+	/* descends while a child is cheaper than making the node itself the sibling */
+	while (!nodes[index].isLeaf()) {
+		const node& current = nodes[index];
+
+		const float area = current.box.surfaceArea();
+		const float combinedArea = aabb::combine(current.box, box).surfaceArea();
+
+		/* a new parent for this node and the leaf */
+		const float cost = 2.0f * combinedArea;
+		/* every ancestor of a child has to grow as well */
+		const float inheritanceCost = 2.0f * (combinedArea - area);
+
+		auto childCost = [&](int32_t child) {
+			const aabb& childBox = nodes[child].box;
+			const float newArea = aabb::combine(childBox, box).surfaceArea();
+			return nodes[child].isLeaf()
+				? newArea + inheritanceCost
+				: newArea - childBox.surfaceArea() + inheritanceCost;
+		};
+
+		const float cost1 = childCost(current.child1);
+		const float cost2 = childCost(current.child2);
+
+		if (cost < cost1 && cost < cost2) break;
+
+		index = cost1 < cost2 ? current.child1 : current.child2;
+	}
+
+	return index;
+}
+
+void AabbTree::insertLeaf(int32_t leaf) {
+	if (root == AABB_TREE_NULL) {
+		root = leaf;
+		nodes[root].parent = AABB_TREE_NULL;
+		return;
+	}
+
+	const int32_t sibling = findBestSibling(nodes[leaf].box);
+	const int32_t oldParent = nodes[sibling].parent;
+
+	const int32_t newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = aabb::combine(nodes[leaf].box, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == AABB_TREE_NULL) {
+		root = newParent;
+	}
+	else if (nodes[oldParent].child1 == sibling) {
+		nodes[oldParent].child1 = newParent;
+	}
+	else {
+		nodes[oldParent].child2 = newParent;
+	}
+
+	fixUpwards(nodes[leaf].parent);
+}
+
+void AabbTree::removeLeaf(int32_t leaf) {
+	if (leaf == root) {
+		root = AABB_TREE_NULL;
+		return;
+	}
+
+	const int32_t parent = nodes[leaf].parent;
+	const int32_t grandParent = nodes[parent].parent;
+	const int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	/* the sibling takes the place of the parent */
+	if (grandParent == AABB_TREE_NULL) {
+		root = sibling;
+		nodes[sibling].parent = AABB_TREE_NULL;
+		freeNode(parent);
+		return;
+	}
+
+	if (nodes[grandParent].child1 == parent) {
+		nodes[grandParent].child1 = sibling;
+	}
+	else {
+		nodes[grandParent].child2 = sibling;
+	}
+	nodes[sibling].parent = grandParent;
+	freeNode(parent);
+
+	fixUpwards(grandParent);
+}
+
+int32_t AabbTree::balance(int32_t iA) {
+	node& A = nodes[iA];
+	if (A.isLeaf() || A.height < 2) return iA;
+
+	const int32_t iB = A.child1;
+	const int32_t iC = A.child2;
+	node& B = nodes[iB];
+	node& C = nodes[iC];
+
+	const int32_t difference = C.height - B.height;
+
+	/* C is the higher child, it replaces A and A takes its lower child */
+	if (difference > 1) {
+		const int32_t iF = C.child1;
+		const int32_t iG = C.child2;
+		node& F = nodes[iF];
+		node& G = nodes[iG];
+
+		C.child1 = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+
+		if (C.parent == AABB_TREE_NULL) root = iC;
+		else if (nodes[C.parent].child1 == iA) nodes[C.parent].child1 = iC;
+		else nodes[C.parent].child2 = iC;
+
+		if (F.height > G.height) {
+			C.child2 = iF;
+			A.child2 = iG;
+			G.parent = iA;
+			A.box = aabb::combine(B.box, G.box);
+			C.box = aabb::combine(A.box, F.box);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		}
+		else {
+			C.child2 = iG;
+			A.child2 = iF;
+			F.parent = iA;
+			A.box = aabb::combine(B.box, F.box);
+			C.box = aabb::combine(A.box, G.box);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+
+		return iC;
+	}
+
+	/* the same with B */
+	if (difference < -1) {
+		const int32_t iD = B.child1;
+		const int32_t iE = B.child2;
+		node& D = nodes[iD];
+		node& E = nodes[iE];
+
+		B.child1 = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+
+		if (B.parent == AABB_TREE_NULL) root = iB;
+		else if (nodes[B.parent].child1 == iA) nodes[B.parent].child1 = iB;
+		else nodes[B.parent].child2 = iB;
+
+		if (D.height > E.height) {
+			B.child2 = iD;
+			A.child1 = iE;
+			E.parent = iA;
+			A.box = aabb::combine(C.box, E.box);
+			B.box = aabb::combine(A.box, D.box);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		}
+		else {
+			B.child2 = iE;
+			A.child1 = iD;
+			D.parent = iA;
+			A.box = aabb::combine(C.box, D.box);
+			B.box = aabb::combine(A.box, E.box);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+void AabbTree::fixUpwards(int32_t index) {
+	while (index != AABB_TREE_NULL) {
+		index = balance(index);
+
+		node& current = nodes[index];
+		const node& child1 = nodes[current.child1];
+		const node& child2 = nodes[current.child2];
+
+		current.height = 1 + std::max(child1.height, child2.height);
+		current.box = aabb::combine(child1.box, child2.box);
+
+		index = current.parent;
+	}
+}
+
+bool AabbTree::rayHitsBox(const aabb& box, const glm::vec3& origin, const glm::vec3& invDir, float maxT, float& tEnter) {
+	tEnter = 0.0f;
+	float tExit = std::numeric_limits<float>::max();
+
+	for (int axis = 0; axis < 3; axis++) {
+		/* a ray parallel to the slab is in it for all t or never, 0 * inf would be NaN for origins on its planes */
+		if (std::isinf(invDir[axis])) {
+			if (origin[axis] < box.min[axis] || origin[axis] > box.max[axis]) return false;
+			continue;
+		}
+
+		const float t1 = (box.min[axis] - origin[axis]) * invDir[axis];
+		const float t2 = (box.max[axis] - origin[axis]) * invDir[axis];
+		tEnter = std::max(tEnter, std::min(t1, t2));
+		tExit = std::min(tExit, std::max(t1, t2));
+	}
+
+	return tEnter <= tExit && tEnter <= maxT;
+}
+
+int32_t AabbTree::Insert(const aabb& box, uint32_t userData) {
+	const int32_t leaf = allocateNode();
+	nodes[leaf].box = { box.min - glm::vec3(AABB_TREE_MARGIN), box.max + glm::vec3(AABB_TREE_MARGIN) };
+	nodes[leaf].userData = userData;
+
+	insertLeaf(leaf);
+	leafCount++;
+
+	return leaf;
+}
+
+void AabbTree::Remove(int32_t proxy) {
+	if (proxy < 0 || proxy >= static_cast<int32_t>(nodes.size()) || nodes[proxy].height != 0) {
+		throw std::runtime_error("Removing an AABB tree proxy which doesn't exist.");
+	}
+
+	removeLeaf(proxy);
+	freeNode(proxy);
+	leafCount--;
+}
+
+bool AabbTree::Update(int32_t proxy, const aabb& box) {
+	if (nodes[proxy].box.contains(box)) return false;
+
+	removeLeaf(proxy);
+	nodes[proxy].box = { box.min - glm::vec3(AABB_TREE_MARGIN), box.max + glm::vec3(AABB_TREE_MARGIN) };
+	insertLeaf(proxy);
+
+	return true;
+}
+
+uint32_t AabbTree::GetUserData(int32_t proxy) const {
+	return nodes[proxy].userData;
+}
+
+const aabb& AabbTree::GetFatBox(int32_t proxy) const {
+	return nodes[proxy].box;
+}
+
+uint32_t AabbTree::GetLeafCount() const {
+	return leafCount;
+}
+
+int32_t AabbTree::GetHeight() const {
+	return root == AABB_TREE_NULL ? 0 : nodes[root].height;
+}
+
+float AabbTree::GetAreaRatio() const {
+	if (root == AABB_TREE_NULL) return 0.0f;
+
+	float area = 0.0f;
+	for (const node& n : nodes) {
+		if (n.height > 0) area += n.box.surfaceArea();
+	}
+
+	const float rootArea = nodes[root].box.surfaceArea();
+	return rootArea > 0.0f ? area / rootArea : 0.0f;
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+/*
+	A dynamic bounding volume hierarchy of axis aligned boxes.
+
+	Leaves hold fat boxes, enlarged by a margin, so objects moving a little don't
+	change the tree. A leaf leaving its fat box is removed and inserted again: the
+	new sibling is the node with the lowest surface area cost and the ancestors are
+	rotated to keep the heights of siblings within one of each other.
+
+	Nodes live in a pool and are addressed by index, proxies are the leaf indices and
+	stay valid until they are removed.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+constexpr int32_t AABB_TREE_NULL = -1;
+/* how much larger than the object the leaves are */
+constexpr float AABB_TREE_MARGIN = 0.1f;
+
+struct aabb {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	float surfaceArea() const {
+		const glm::vec3 size = max - min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+	bool contains(const aabb& other) const {
+		return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+	}
+	bool overlaps(const aabb& other) const {
+		return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::greaterThanEqual(max, other.min));
+	}
+
+	static aabb combine(const aabb& a, const aabb& b) {
+		return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+	}
+};
+
+class AabbTree {
+private:
+	struct node {
+		/* fat for leaves */
+		aabb box;
+		/* the next free node while the node is in the free list */
+		int32_t parent;
+		int32_t child1;
+		int32_t child2;
+		/* 0 for leaves, -1 for free nodes */
+		int32_t height;
+		uint32_t userData;
+
+		bool isLeaf() const { return child1 == AABB_TREE_NULL; }
+	};
+
+	std::vector<node> nodes;
+	int32_t root;
+	int32_t freeList;
+	uint32_t leafCount;
+
+	std::vector<int32_t> stack;
+
+	int32_t allocateNode();
+	void freeNode(int32_t index);
+
+	int32_t findBestSibling(const aabb& box) const;
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	/* rotates the subtree at index if it's unbalanced and returns its new root */
+	int32_t balance(int32_t index);
+	/* refits and balances from index up to the root */
+	void fixUpwards(int32_t index);
+
+	static bool rayHitsBox(const aabb& box, const glm::vec3& origin, const glm::vec3& invDir, float maxT, float& tEnter);
+
+public:
+	AabbTree();
+
+	/* box is the tight box of the object, the leaf gets a fat one */
+	int32_t Insert(const aabb& box, uint32_t userData);
+	void Remove(int32_t proxy);
+	/* false if the box still fits into the fat box of the leaf and nothing changed */
+	bool Update(int32_t proxy, const aabb& box);
+
+	uint32_t GetUserData(int32_t proxy) const;
+	const aabb& GetFatBox(int32_t proxy) const;
+
+	uint32_t GetLeafCount() const;
+	int32_t GetHeight() const;
+	/* the sum of the surface areas of the inner nodes relative to the root's, lower is better */
+	float GetAreaRatio() const;
+
+	/* callback(userData) for the leaves touching the frustum, planes point inside */
+	template <class Callback>
+	void QueryFrustum(const std::array<glm::vec4, 6>& planes, Callback&& callback);
+	/* callback(userData) for the leaves overlapping the sphere */
+	template <class Callback>
+	void QuerySphere(const glm::vec3& center, float radius, Callback&& callback);
+	/* callback(userData, tEnter) for the leaves the ray enters before maxT, in no particular order,
+	   it returns the new maxT, so returning the distance of a hit finds the closest one */
+	template <class Callback>
+	void QueryRay(const glm::vec3& origin, const glm::vec3& dir, float maxT, Callback&& callback);
+};
+
+template <class Callback>
+void AabbTree::QueryFrustum(const std::array<glm::vec4, 6>& planes, Callback&& callback) {
+	if (root == AABB_TREE_NULL) return;
+
+	stack.clear();
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		const node& current = nodes[stack.back()];
+		stack.pop_back();
+
+		const glm::vec3 center = (current.box.min + current.box.max) * 0.5f;
+		const glm::vec3 extent = (current.box.max - current.box.min) * 0.5f;
+
+		bool outside = false;
+		for (const glm::vec4& plane : planes) {
+			const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			if (distance < -glm::dot(glm::abs(glm::vec3(plane)), extent)) {
+				outside = true;
+				break;
+			}
+		}
+		if (outside) continue;
+
+		if (current.isLeaf()) {
+			callback(current.userData);
+		}
+		else {
+			stack.push_back(current.child1);
+			stack.push_back(current.child2);
+		}
+	}
+}
+
+template <class Callback>
+void AabbTree::QuerySphere(const glm::vec3& center, float radius, Callback&& callback) {
+	if (root == AABB_TREE_NULL) return;
+
+	stack.clear();
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		const node& current = nodes[stack.back()];
+		stack.pop_back();
+
+		const glm::vec3 closest = glm::clamp(center, current.box.min, current.box.max);
+		const glm::vec3 offset = closest - center;
+		if (glm::dot(offset, offset) > radius * radius) continue;
+
+		if (current.isLeaf()) {
+			callback(current.userData);
+		}
+		else {
+			stack.push_back(current.child1);
+			stack.push_back(current.child2);
+		}
+	}
+}
+
+template <class Callback>
+void AabbTree::QueryRay(const glm::vec3& origin, const glm::vec3& dir, float maxT, Callback&& callback) {
+	if (root == AABB_TREE_NULL) return;
+
+	/* infinite for the axes the ray is parallel to, rayHitsBox handles those */
+	const glm::vec3 invDir = 1.0f / dir;
+
+	stack.clear();
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		const node& current = nodes[stack.back()];
+		stack.pop_back();
+
+		float tEnter;
+		if (!rayHitsBox(current.box, origin, invDir, maxT, tEnter)) continue;
+
+		if (current.isLeaf()) {
+			maxT = callback(current.userData, tEnter);
+		}
+		else {
+			stack.push_back(current.child1);
+			stack.push_back(current.child2);
+		}
+	}
+}
\ No newline at end of file
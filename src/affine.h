@@ -0,0 +1,60 @@
+/*
+	Affine transforms stored as 3x4 matrices (glm::mat4x3: four columns, three rows).
+
+	The fourth row of every matrix we build is always (0, 0, 0, 1), so there is no point
+	in storing it or multiplying by it.
+*/
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+
+namespace affine {
+	inline glm::mat4x3 identity() {
+		return glm::mat4x3(1.0f);
+	}
+
+	inline glm::mat4x3 fromMat4(const glm::mat4& m) {
+		return glm::mat4x3(glm::vec3(m[0]), glm::vec3(m[1]), glm::vec3(m[2]), glm::vec3(m[3]));
+	}
+
+	inline glm::mat4 toMat4(const glm::mat4x3& m) {
+		return glm::mat4(
+			glm::vec4(m[0], 0.0f),
+			glm::vec4(m[1], 0.0f),
+			glm::vec4(m[2], 0.0f),
+			glm::vec4(m[3], 1.0f)
+		);
+	}
+
+	/* the same as a * b with the implicit fourth rows */
+	inline glm::mat4x3 multiply(const glm::mat4x3& a, const glm::mat4x3& b) {
+		const glm::mat3 linear(a[0], a[1], a[2]);
+
+		return glm::mat4x3(
+			linear * b[0],
+			linear * b[1],
+			linear * b[2],
+			linear * b[3] + a[3]
+		);
+	}
+
+	inline glm::mat4x3 inverse(const glm::mat4x3& m) {
+		const glm::mat3 linear = glm::inverse(glm::mat3(m[0], m[1], m[2]));
+		return glm::mat4x3(linear[0], linear[1], linear[2], -(linear * m[3]));
+	}
+
+	inline glm::vec3 transformPoint(const glm::mat4x3& m, const glm::vec3& p) {
+		return m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3];
+	}
+
+	inline glm::vec3 transformDirection(const glm::mat4x3& m, const glm::vec3& d) {
+		return m[0] * d.x + m[1] * d.y + m[2] * d.z;
+	}
+
+	/* the inverse transpose of the linear part, transforms normals */
+	inline glm::mat3 normalMatrix(const glm::mat4x3& m) {
+		return glm::transpose(glm::inverse(glm::mat3(m[0], m[1], m[2])));
+	}
+}
\ No newline at end of file
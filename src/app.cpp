@@ -1,46 +1,115 @@
 #include "app.h"
 
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
 
 #include <glm/ext/scalar_constants.hpp>
+#include <glm/gtc/constants.hpp>
 
 #include "systems.h"
 #include "constants.h"
 #include "factories.h"
-
+#include "glDebug.h"
+#include "headlessContext.h"
+#include "hierarchy.h"
+#include "profiler.h"
+#include "textureFile.h"
+
+#include "comps/boundsProxy.h"
+#include "comps/child.h"
 #include "comps/scale.h"
 #include "comps/transform.h"
+#include "comps/orbiting.h"
+#include "comps/dynamicallyScaled.h"
 
 
-App::App(int width, int height) : window(nullptr, &SDL_DestroyWindow) {
+App::App(int width, int height, bool headless) : window(nullptr, &SDL_DestroyWindow), context(nullptr) {
 	running = false;
-	freeCameraMode = true;
+	this->headless = headless;
+	freeCameraMode = !headless;
 
 	fps = 60;
 
-	setGLAttributes();
-	createWindow(width, height);
-	createContext(width, height);
+	PROFILE_THREAD_NAME("main");
+
+	if (headless) createHeadlessContext();
+	if (!headlessContext) {
+		initVideo();
+		setGLAttributes();
+		createWindow(width, height);
+		createContext();
+	}
+	initGLState(width, height);
 
 	//prgMngr = std::make_shared<ProgramManager>();
 	registry = std::make_shared<entt::registry>();
+	hierarchy::init(registry);
+	systems::initTransformTracking(registry);
+	systems::initBoundsTree(registry);
+	systems::initCulling(registry);
+	systems::initOcclusion(registry);
+	systems::initShadows(registry);
+	systems::initLights(registry);
+	threadPool = std::make_shared<ThreadPool>();
+	createScheduler();
 	modelMngr = std::make_shared<ModelManager>(registry);
+	uniformBuffers = std::make_unique<UniformBuffers>();
+	renderQueue = std::make_unique<RenderQueue>();
+	shadowMaps = std::make_unique<ShadowMaps>(modelMngr->GetShader("shadow"), modelMngr->GetPositionVao());
+	lightClusters = std::make_unique<LightClusters>();
 	camera = std::make_unique<Camera>(glm::vec3(0.0f, 1.8f, 20.0f), 0.0f, 0.0f, 45.0f, width, height, 1.0f, 300.0f, 10.0f);
+	if (headless) target = std::make_unique<RenderTarget>(width, height);
 	//postprocess = std::make_unique<PostprocessManager>(width, height, "./shaders/postprocess-vertex.glsl", "./shaders/postprocess-fragment.glsl");
 }
 
 App::~App() {
-	SDL_DestroyWindow(window.get());
+	window.reset();
 	SDL_Quit();
 }
 
+void App::initVideo() {
+	/* the SDL_GL attributes are dropped unless video is already running */
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO) == 0) return;
+
+	std::string drivers;
+	for (int i = 0; i < SDL_GetNumVideoDrivers(); i++) {
+		if (!drivers.empty()) drivers += ", ";
+		drivers += SDL_GetVideoDriver(i);
+	}
+	throw std::runtime_error(std::string("Error starting SDL video: ") + SDL_GetError() + " (drivers in this SDL build: " + (drivers.empty() ? "none" : drivers) + ")");
+}
+
+void App::createHeadlessContext() {
+	try {
+		headlessContext = std::make_unique<HeadlessContext>();
+	}
+	catch (const std::runtime_error& e) {
+		/* without EGL a hidden window still gives a context wherever the video driver can make one */
+		std::cerr << e.what() << " Rendering headless in a hidden window instead." << std::endl;
+		return;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::GetProcAddress)) {
+		throw std::runtime_error("Error loading the OpenGL functions of the headless context.");
+	}
+}
+
 void App::setGLAttributes() {
 	SDL_GL_LoadLibrary(NULL);
 
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+#if GL_DEBUG_ENABLED
+	/* drivers report much more in debug contexts */
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+#endif
 
 	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 5);
 	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 5);
@@ -50,27 +119,32 @@ void App::setGLAttributes() {
 }
 
 void App::createWindow(int width, int height) {
-	window.reset(SDL_CreateWindow("A 3D Graphics Render.", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE));
+	window.reset(SDL_CreateWindow("A 3D Graphics Render.", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL | (headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE)));
 	if (window == nullptr) {
-		std::cerr << "Error creating window: " << SDL_GetError() << std::endl;
-		exit(1);
+		throw std::runtime_error(std::string("Error creating the window with the ") + SDL_GetCurrentVideoDriver() + " video driver: " + SDL_GetError());
 	}
 
 	SDL_SetRelativeMouseMode((SDL_bool)freeCameraMode);
 	SDL_CaptureMouse((SDL_bool)freeCameraMode);
 }
 
-void App::createContext(int width, int height) {
+void App::createContext() {
 	context = SDL_GL_CreateContext(window.get());
-	if (!window) {
-		std::cerr << "Error creating SDL window";
+	if (context == nullptr) {
+		throw std::runtime_error(std::string("Error creating the GL context: ") + SDL_GetError());
+	}
+	if (!gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress)) {
+		throw std::runtime_error("Error loading the OpenGL functions.");
 	}
-	gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress);
 
-	glViewport(0, 0, (GLsizei)width, (GLsizei)height);
+	// Use v-sync, headless frames are never shown
+	SDL_GL_SetSwapInterval(headless ? 0 : 1);
+}
 
-	// Use v-sync
-	SDL_GL_SetSwapInterval(1);
+void App::initGLState(int width, int height) {
+	GL_DEBUG_INIT();
+
+	glViewport(0, 0, (GLsizei)width, (GLsizei)height);
 
 	glEnable(GL_DEPTH_TEST);
 	glDepthMask(GL_TRUE);
@@ -94,6 +168,59 @@ void App::setup() {
 	registry->emplace<comps::rotatedByKeyboard<EAngle::PITCH>>(light, SDL_SCANCODE_DOWN, SDL_SCANCODE_UP, 90.0f, false, 0.0f, 180.0f);
 
 	factories::createTree(registry, modelMngr, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+
+	factories::createSpotLight(registry, Color::RGB("#FFE8C0"),
+		0.0f, 1.0f, 1.0f,
+		glm::vec3(0.0f, 12.0f, 0.0f), 0.0f, 0.0f, 0.0f,
+		20.0f, 20.0f, 30.0f
+	);
+
+	/* small circles on the ground, the phases of x and z are a quarter apart */
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (uint32_t i = 0; i < DEMO_POINT_LIGHTS; i++) {
+		const glm::vec3 center(unit(rng) * 80.0f - 40.0f, 0.5f + unit(rng) * 3.0f, unit(rng) * 80.0f - 40.0f);
+		const float phase = unit(rng) * glm::two_pi<float>();
+
+		auto point = factories::createPointLight(registry, Color::RGB(Color::LCH(70.0f, 60.0f, unit(rng) * 360.0f)),
+			0.0f, 1.0f, 0.5f,
+			center, 3.0f + unit(rng) * 3.0f
+		);
+		registry->emplace<comps::orbiting>(point, glm::vec3(2.0f + unit(rng) * 4.0f), glm::vec3(1.0f, 0.0f, 1.0f), glm::vec3(phase, 0.0f, phase + glm::half_pi<float>()), center);
+	}
+}
+
+/* the systems the way the scheduler calls them */
+void orbitPosTask(frameContext& ctx) { systems::orbitPos(ctx.registry); }
+void keyboardRotateTask(frameContext& ctx) { systems::keyboardRotate(ctx.registry, ctx.dt); }
+void keyboardMoveTask(frameContext& ctx) { systems::keyboardMove(ctx.registry, ctx.dt); }
+void dynamicallyScaleTask(frameContext& ctx) { systems::dynamicallyScale(ctx.registry); }
+void calcTransformsTask(frameContext& ctx) { systems::calcTransforms(ctx.registry, ctx.threadPool); }
+void calcAbsoluteTransformTask(frameContext& ctx) { systems::calcAbsoluteTransform(ctx.registry, ctx.threadPool); }
+void calcNormalMatricesTask(frameContext& ctx) { systems::calcNormalMatrices(ctx.registry, ctx.threadPool); }
+void updateBoundsTreeTask(frameContext& ctx) { systems::updateBoundsTree(ctx.registry); }
+
+void App::createScheduler() {
+	scheduler = std::make_unique<Scheduler>(registry, threadPool);
+
+	/* the order matters only between conflicting systems, patching a component writes its comps::changed through the signals */
+	scheduler->Add<&orbitPosTask,
+		const comps::orbiting, comps::position, comps::changed<comps::position>>("orbitPos");
+	scheduler->Add<&keyboardRotateTask,
+		comps::orientation, const comps::rotatedByKeyboard<EAngle::YAW>, const comps::rotatedByKeyboard<EAngle::PITCH>, const comps::rotatedByKeyboard<EAngle::ROLL>, comps::changed<comps::orientation>>("keyboardRotate");
+	scheduler->Add<&dynamicallyScaleTask,
+		comps::scale, const comps::dynamicallyScaled, comps::changed<comps::scale>>("dynamicallyScale");
+	/* moves along the orientation, so it runs after keyboardRotate, and it writes positions like orbitPos */
+	scheduler->Add<&keyboardMoveTask,
+		comps::position, const comps::orientation, const comps::movedByKeyboard<Axis::X>, const comps::movedByKeyboard<Axis::Y>, const comps::movedByKeyboard<Axis::Z>, comps::changed<comps::position>>("keyboardMove");
+	scheduler->Add<&calcTransformsTask,
+		const comps::position, const comps::orientation, const comps::scale, comps::changed<comps::position>, comps::changed<comps::orientation>, comps::changed<comps::scale>, comps::transformDirty, comps::localTransform>("calcTransforms");
+	scheduler->Add<&calcAbsoluteTransformTask,
+		const comps::child, const comps::parent, const comps::localTransform, comps::worldTransform, comps::transformDirty>("calcAbsoluteTransform");
+	scheduler->Add<&calcNormalMatricesTask,
+		const comps::worldTransform, comps::normalTransform>("calcNormalMatrices");
+	scheduler->Add<&updateBoundsTreeTask,
+		const comps::mesh, const comps::worldTransform, const comps::boundsProxy>("updateBoundsTree");
 }
 
 void App::run() {
@@ -101,16 +228,93 @@ void App::run() {
 
 	running = true;
 	while (running) {
-		handleEvents();
+		{
+			PROFILE_SCOPE("frame");
 
-		float dt = calcDeltaTime();
+			handleEvents();
 
-		update(dt);
-		render();
+			float dt = calcDeltaTime();
+
+			update(dt);
+			render();
+		}
+		PROFILE_END_FRAME();
 	}
 }
 
+void App::runHeadless(const headlessSettings& settings) {
+	if (!headless) {
+		throw std::runtime_error("runHeadless needs an app created headless.");
+	}
+
+	setup();
+	std::filesystem::create_directories(settings.outputDir);
+
+	/* a fixed step makes the frames the same on every run */
+	const float dt = 1.0f / fps;
+	const double ticksPerMs = SDL_GetPerformanceFrequency() / 1000.0;
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	std::vector<double> cpuTimes(settings.frames), gpuTimes(settings.frames);
+
+	for (uint32_t frame = 0; frame < settings.frames; frame++) {
+		{
+			PROFILE_SCOPE("frame");
+
+			const Uint64 start = SDL_GetPerformanceCounter();
+			glBeginQuery(GL_TIME_ELAPSED, query);
+
+			update(dt);
+			render();
+
+			glEndQuery(GL_TIME_ELAPSED);
+			cpuTimes[frame] = (SDL_GetPerformanceCounter() - start) / ticksPerMs;
+
+			/* waits for the GPU, like the swap of a window would */
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			gpuTimes[frame] = elapsed / 1e6;
+		}
+		PROFILE_END_FRAME();
+
+		const bool last = frame + 1 == settings.frames;
+		if (last || (settings.captureEvery != 0 && frame % settings.captureEvery == 0)) {
+			std::ostringstream name;
+			name << "frame-" << std::setw(5) << std::setfill('0') << frame << ".png";
+			saveColorTextureToFile(target->GetColorTexture(), target->GetWidth(), target->GetHeight(), (settings.outputDir / name.str()).string());
+		}
+	}
+
+	glDeleteQueries(1, &query);
+
+	std::ofstream timings(settings.outputDir / "timings.csv");
+	timings << "frame,cpu_ms,gpu_ms\n";
+	for (uint32_t frame = 0; frame < settings.frames; frame++) {
+		timings << frame << "," << cpuTimes[frame] << "," << gpuTimes[frame] << "\n";
+	}
+
+	if (settings.frames == 0) return;
+
+	auto summary = [](const char* name, std::vector<double> times) {
+		std::sort(times.begin(), times.end());
+		double sum = 0.0;
+		for (double time : times) sum += time;
+		std::cout << name << ": mean " << sum / times.size() << " ms, median " << times[times.size() / 2]
+			<< " ms, 95th percentile " << times[times.size() * 95 / 100] << " ms, max " << times.back() << " ms" << std::endl;
+	};
+	summary("CPU", cpuTimes);
+	summary("GPU", gpuTimes);
+}
+
+void App::setLodSettings(const lodSettings& settings) {
+	lods = settings;
+}
+
 float App::calcDeltaTime() {
+	PROFILE_SCOPE("App::calcDeltaTime");
+
 	static Uint64 millisecsPreviusFrame = 0;
 
 	const int millisecsPerFrame = 1000 / fps;
@@ -127,6 +331,8 @@ float App::calcDeltaTime() {
 }
 
 void App::handleEvents() {
+	PROFILE_SCOPE("App::handleEvents");
+
 	SDL_Event event;
 	while (SDL_PollEvent(&event)) {
 		switch (event.type) {
@@ -139,6 +345,45 @@ void App::handleEvents() {
 				SDL_SetRelativeMouseMode((SDL_bool)freeCameraMode);
 				SDL_CaptureMouse((SDL_bool)freeCameraMode);
 			}
+			else if (event.key.keysym.sym == SDLK_F1) {
+				std::ofstream graphFile("systems.dot");
+				scheduler->WriteGraph(graphFile);
+				scheduler->WriteTimings(std::cout);
+
+				std::cout << "Culling: " << cullingStats.visible << " of " << cullingStats.tested << " visible, "
+					<< cullingStats.frustumCulled << " outside the frustum, " << cullingStats.smallCulled << " too small, "
+					<< cullingStats.occlusionCulled << " occluded by " << cullingStats.occluderTriangles << " triangles" << std::endl;
+				std::cout << "Levels of detail:";
+				for (uint32_t count : cullingStats.lods) std::cout << " " << count;
+				std::cout << std::endl;
+
+				const renderStats& stats = renderQueue->GetStats();
+				std::cout << "Last frame: " << stats.packets << " packets in " << stats.draws << " draws ("
+					<< stats.instances << " instances in " << stats.instancedDraws << " instanced and " << stats.multiDraws << " multi draws), " << stats.programBinds << " program binds, "
+					<< stats.vaoBinds << " vao binds, " << stats.materialUploads << " material uploads, " << stats.materialBinds << " material binds, "
+					<< stats.objectBinds << " object binds, " << stats.instanceAttribBinds << " instance attribute binds, "
+					<< stats.bindsAvoided << " binds avoided" << std::endl;
+
+				const shadowStats& shadows = shadowMaps->GetStats();
+				std::cout << "Shadows: " << shadows.staticCasters << " static and " << shadows.dynamicCasters << " dynamic casters in "
+					<< shadows.draws << " draws, " << shadows.staticRedraws << " cached cascades redrawn" << std::endl;
+
+				const clusterStats& clusters = lightClusters->GetStats();
+				std::cout << "Clustered lights: " << clusters.lights << " lights, " << clusters.indices << " indices, at most "
+					<< clusters.maxPerCluster << " in a froxel, " << clusters.overflowing << " froxels overflowing" << std::endl;
+
+				const AabbTree& tree = registry->ctx().get<AabbTree>();
+				std::cout << "Bounds tree: " << tree.GetLeafCount() << " leaves, height " << tree.GetHeight()
+					<< ", area ratio " << tree.GetAreaRatio() << std::endl;
+			}
+			else if (event.key.keysym.sym == SDLK_F2) {
+				PROFILE_BEGIN_CAPTURE(PROFILE_CAPTURE_FRAMES, "trace.json");
+			}
+			else if (event.key.keysym.sym == SDLK_F3) {
+				const entt::entity picked = systems::pickEntity(registry, camera->getPosition(), camera->getFront());
+				if (picked == entt::null) std::cout << "Nothing in front of the camera" << std::endl;
+				else std::cout << "Picked entity " << entt::to_integral(picked) << std::endl;
+			}
 			break;
 		case SDL_WINDOWEVENT:
 			if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
@@ -161,33 +406,37 @@ void App::handleEvents() {
 }
 
 void App::update(float dt) {
-	if (freeCameraMode) camera->update(dt);
-
-	systems::orbitPos(registry);
+	PROFILE_SCOPE("App::update");
 
-	systems::keyboardRotate(registry, dt);
-	systems::keyboardMove(registry, dt);
-	
-	systems::dynamicallyScale(registry);
+	if (freeCameraMode) camera->update(dt);
 
-	systems::calcTransforms(registry);
-	systems::clearTransformCache(registry);
-	systems::calcAbsoluteTransform(registry);
+	scheduler->Run(dt);
+	/* adds components, which the tasks running next to each other can't */
+	systems::insertBoundsProxies(registry);
 }
 
 void App::render() {
+	PROFILE_SCOPE("App::render");
+
 	Color::RGB bgColor = Color::RGB("#615d54");
 
+	if (target) target->Bind();
+
 	glClearColor(bgColor.r, bgColor.g, bgColor.b, 1.0f);
 	glClearDepth(1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
 	//postprocess->BeforeRender(bgColor);
-	systems::render(registry, camera, modelMngr);
+	systems::render(registry, camera, uniformBuffers, renderQueue, shadowMaps, lightClusters, threadPool, lods, cullingStats);
 	//postprocess->AfterRender(bgColor, camera);
 
-	SDL_GL_SwapWindow(window.get());
+	if (headless) return;
+
+	{
+		PROFILE_SCOPE("SDL_GL_SwapWindow");
+		SDL_GL_SwapWindow(window.get());
+	}
 }
 
 void App::resize(int width, int height) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <filesystem>
 #include <memory>
 #include <mutex>
 
@@ -11,14 +12,43 @@
 #include "modelManager/modelManager.h"
 #include "postprocessManager.h"
 #include "camera.h"
-
+#include "threadPool.h"
+#include "scheduler.h"
+#include "uniformBuffers.h"
+#include "renderQueue.h"
+#include "culling.h"
+#include "renderTarget.h"
+#include "shadowMaps.h"
+#include "lightClusters.h"
+
+
+class HeadlessContext;
+
+/* frames recorded by a profile capture, started with F2 */
+constexpr uint32_t PROFILE_CAPTURE_FRAMES = 120;
+/* the point lights setup scatters around the tree, too many to light every fragment with */
+constexpr uint32_t DEMO_POINT_LIGHTS = 2048;
+
+/* what runHeadless renders and where it writes the frames and the timings */
+struct headlessSettings {
+	uint32_t frames = 300;
+	/* every n-th frame is saved, 0 saves only the last one */
+	uint32_t captureEvery = 0;
+	std::filesystem::path outputDir = "headless";
+};
 
 class App {
 private:
 	bool running;
 	bool freeCameraMode;
+	/* no visible window, frames go to the render target */
+	bool headless;
+	/* declared before everything that deletes GL objects so it outlives them, null with a window */
+	std::unique_ptr<HeadlessContext> headlessContext;
 
 	std::shared_ptr<entt::registry> registry;
+	std::shared_ptr<ThreadPool> threadPool;
+	std::unique_ptr<Scheduler> scheduler;
 	//std::mutex registryEntityCreateMtx;
 	
 	std::unique_ptr<SDL_Window, decltype(&SDL_DestroyWindow)> window;
@@ -27,6 +57,13 @@ private:
 	std::shared_ptr<ModelManager> modelMngr;
 
 	std::unique_ptr<Camera> camera;
+	std::unique_ptr<UniformBuffers> uniformBuffers;
+	std::unique_ptr<RenderQueue> renderQueue;
+	std::unique_ptr<ShadowMaps> shadowMaps;
+	std::unique_ptr<LightClusters> lightClusters;
+	std::unique_ptr<RenderTarget> target;
+	cullStats cullingStats;
+	lodSettings lods;
 
 	//std::unique_ptr<PostprocessManager> postprocess;
 
@@ -36,12 +73,16 @@ private:
 
 	int fps;
 
+	void initVideo();
 	void setGLAttributes();
 	void createWindow(int width, int height);
-	void createContext(int width, int height);
+	void createContext();
+	void createHeadlessContext();
+	void initGLState(int width, int height);
 	//void createFramebuffer(int width, int height);
 
 	void setup();
+	void createScheduler();
 
 	float calcDeltaTime();
 
@@ -51,8 +92,14 @@ private:
 
 	void resize(int width, int height);
 public:
-	App(int width, int height);
+	/* headless apps render offscreen on an EGL context, or in a hidden window if there is no EGL */
+	App(int width, int height, bool headless = false);
 	~App();
 
 	void run();
+	/* renders the frames with a fixed time step as fast as possible, throws if the app isn't headless */
+	void runHeadless(const headlessSettings& settings);
+
+	/* how coarse the levels of detail render picks are */
+	void setLodSettings(const lodSettings& settings);
 };
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "constants.h"
+#include "culling.h"
 
 
 Camera::Camera(glm::vec3 position, float yaw, float pitch, float fov, int windowWidth, int windowHeight, float near, float far, float speed)
@@ -85,6 +86,14 @@ void Camera::resizeCallback(int windowWidth, int windowHeight) {
 	projection = glm::perspective(glm::radians(fov), aspectRatio, near, far);
 }
 
+glm::vec3 Camera::getPosition() const {
+	return position;
+}
+
+glm::vec3 Camera::getFront() const {
+	return front;
+}
+
 glm::mat4 Camera::getView() const {
 	return view;
 }
@@ -93,6 +102,10 @@ glm::mat4 Camera::getProjection() const {
 	return projection;
 }
 
+std::array<glm::vec4, 6> Camera::getFrustumPlanes() const {
+	return culling::extractPlanes(projection * view);
+}
+
 float Camera::getZNear() const {
 	return near;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include <glm/glm.hpp>
 
 class Camera {
@@ -36,8 +38,12 @@ public:
 	void scrollCallback(float y);
 	void resizeCallback(int windowWidth, int windowHeight);
 
+	glm::vec3 getPosition() const;
+	glm::vec3 getFront() const;
 	glm::mat4 getView() const;
 	glm::mat4 getProjection() const;
+	/* left, right, bottom, top, near, far in world space, normalized and pointing inside */
+	std::array<glm::vec4, 6> getFrustumPlanes() const;
 
 	float getZNear() const;
 	float getZFar() const;
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+
+namespace comps {
+	/* the leaf of the entity in the bounds tree, removed from the tree with the component */
+	struct boundsProxy {
+		int32_t proxy;
+	};
+}
\ No newline at end of file
@@ -1,11 +1,24 @@
 #pragma once
 
+#include <cstdint>
+
 #include <entt/entt.hpp>
 
 
 namespace comps {
 	struct child {
-		entt::entity parent;
-		bool hasBeenCalculated;
+		entt::entity parent = entt::null;
+		/* number of ancestors, kept up to date by the hierarchy functions */
+		uint32_t depth = 0;
+
+		/* the other children of the parent form a doubly linked list */
+		entt::entity prevSibling = entt::null;
+		entt::entity nextSibling = entt::null;
+	};
+
+	/* present on every entity that has been a parent, the list may be empty */
+	struct parent {
+		entt::entity firstChild = entt::null;
+		uint32_t childCount = 0;
 	};
 }
\ No newline at end of file
@@ -13,4 +13,17 @@ namespace comps {
 
 	/* The base direction is always down */
 	struct dirLight {};
+
+	/* lights everything around its world position, fading out at range */
+	struct pointLight {
+		float range;
+	};
+
+	/* a point light in a cone around the base direction, down,
+	   the angles from the axis are in degrees, it fades from the inner to the outer one */
+	struct spotLight {
+		float range;
+		float innerAngle;
+		float outerAngle;
+	};
 }
\ No newline at end of file
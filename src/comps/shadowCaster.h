@@ -0,0 +1,8 @@
+#pragma once
+
+
+namespace comps {
+	/* the entity doesn't move, its shadows are drawn into the static cache of the cascades,
+	   only adding, removing or moving such entities draws the cache again */
+	struct staticShadowCaster {};
+}
\ No newline at end of file
@@ -2,9 +2,31 @@
 
 #include <glm/glm.hpp>
 
+#include "../affine.h"
+
 
 namespace comps {
-	struct transform {
-		glm::mat4 matrix;
+	/* relative to the parent, rebuilt only when the position, orientation or scale changes */
+	struct localTransform {
+		glm::mat4x3 matrix{ 1.0f };
+	};
+
+	/* absolute, the parent's world matrix times the local matrix */
+	struct worldTransform {
+		glm::mat4x3 matrix{ 1.0f };
 	};
+
+	/* the inverse transpose of the world matrix's linear part, recalculated only when the world matrix changes */
+	struct normalTransform {
+		glm::mat3 matrix{ 1.0f };
+	};
+
+	/* the Component of the entity changed since the last frame, one storage per component,
+	   so the systems writing different components don't share one */
+	template <class Component>
+	struct changed {};
+
+	/* the position, orientation, scale or parent changed since the last frame,
+	   after calcAbsoluteTransform also set on entities whose world matrix changed */
+	struct transformDirty {};
 }
\ No newline at end of file
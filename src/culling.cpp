@@ -0,0 +1,169 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULLING_SSE 1
+#include <immintrin.h>
+#else
+#define CULLING_SSE 0
+#endif
+
+
+std::array<glm::vec4, 6> culling::extractPlanes(const glm::mat4& viewProjection) {
+	/* the rows of the view projection matrix (Gribb & Hartmann) */
+	const glm::mat4& m = viewProjection;
+	const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	std::array<glm::vec4, 6> planes = {
+		row3 + row0, row3 - row0,
+		row3 + row1, row3 - row1,
+		row3 + row2, row3 - row2
+	};
+	for (glm::vec4& plane : planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return planes;
+}
+
+culling::frustum culling::makeFrustum(const std::array<glm::vec4, 6>& planes, const glm::mat4& view, const glm::mat4& projection, float minScreenSize) {
+	frustum result{};
+	result.planes = planes;
+	/* the camera looks down -z, so the depth is minus the third row of the view matrix */
+	result.depth = -glm::vec4(view[0][2], view[1][2], view[2][2], view[3][2]);
+	/* a sphere covers about 2 * radius * proj[1][1] / depth / 2 of the viewport height */
+	result.sizePerDepth = minScreenSize / projection[1][1];
+	result.projectionScale = projection[1][1] * 0.5f;
+	return result;
+}
+
+static culling::result testSphere(const culling::frustum& frustum, float x, float y, float z, float radius) {
+	bool intersecting = false;
+
+	for (const glm::vec4& plane : frustum.planes) {
+		const float distance = plane.x * x + plane.y * y + plane.z * z + plane.w;
+		if (distance < -radius) return culling::result::Outside;
+		if (distance < radius) intersecting = true;
+	}
+
+	const float depth = frustum.depth.x * x + frustum.depth.y * y + frustum.depth.z * z + frustum.depth.w;
+	if (radius < frustum.sizePerDepth * depth) return culling::result::TooSmall;
+
+	return intersecting ? culling::result::Intersecting : culling::result::Inside;
+}
+
+#if CULLING_SSE
+
+static size_t testSpheresSSE(const culling::frustum& frustum, const culling::spheres& in, size_t count, culling::result* out) {
+	const size_t end = count - count % 4;
+
+	for (size_t i = 0; i < end; i += 4) {
+		const __m128 x = _mm_loadu_ps(in.x + i);
+		const __m128 y = _mm_loadu_ps(in.y + i);
+		const __m128 z = _mm_loadu_ps(in.z + i);
+		const __m128 radius = _mm_loadu_ps(in.radius + i);
+		const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+		__m128 outside = _mm_setzero_ps();
+		__m128 intersecting = _mm_setzero_ps();
+
+		for (const glm::vec4& plane : frustum.planes) {
+			__m128 distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_set1_ps(plane.w));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), y));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), z));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+			intersecting = _mm_or_ps(intersecting, _mm_cmplt_ps(distance, radius));
+		}
+
+		const glm::vec4& d = frustum.depth;
+		__m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(d.x), x), _mm_set1_ps(d.w));
+		depth = _mm_add_ps(depth, _mm_mul_ps(_mm_set1_ps(d.y), y));
+		depth = _mm_add_ps(depth, _mm_mul_ps(_mm_set1_ps(d.z), z));
+		const __m128 small = _mm_cmplt_ps(radius, _mm_mul_ps(_mm_set1_ps(frustum.sizePerDepth), depth));
+
+		const int outsideMask = _mm_movemask_ps(outside);
+		const int smallMask = _mm_movemask_ps(small);
+		const int intersectingMask = _mm_movemask_ps(intersecting);
+
+		for (int lane = 0; lane < 4; lane++) {
+			const int bit = 1 << lane;
+			out[i + lane] = (outsideMask & bit) ? culling::result::Outside
+				: (smallMask & bit) ? culling::result::TooSmall
+				: (intersectingMask & bit) ? culling::result::Intersecting
+				: culling::result::Inside;
+		}
+	}
+
+	return end;
+}
+
+#endif
+
+void culling::testSpheres(const frustum& frustum, const spheres& in, size_t count, result* out) {
+	size_t done = 0;
+#if CULLING_SSE
+	done = testSpheresSSE(frustum, in, count, out);
+#endif
+
+	for (size_t i = done; i < count; i++) {
+		out[i] = testSphere(frustum, in.x[i], in.y[i], in.z[i], in.radius[i]);
+	}
+}
+
+bool culling::testBox(const frustum& frustum, const Bounds& bounds, const glm::mat4x3& model) {
+	const glm::vec3 center = model * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f);
+	const glm::vec3 halfSize = (bounds.max - bounds.min) * 0.5f;
+
+	/* the half size of the box around the transformed box */
+	const glm::mat3 absolute(glm::abs(model[0]), glm::abs(model[1]), glm::abs(model[2]));
+	const glm::vec3 extent = absolute * halfSize;
+
+	for (const glm::vec4& plane : frustum.planes) {
+		const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+		const float reach = glm::dot(glm::abs(glm::vec3(plane)), extent);
+		if (distance < -reach) return false;
+	}
+	return true;
+}
+
+uint32_t culling::selectLod(const frustum& frustum, const lodSettings& settings, const MeshLod* lods, uint32_t lodCount, uint32_t current, float scale, float depth) {
+	/* inside the near plane everything is large */
+	if (depth <= 0.0f || lodCount < 2) return 0;
+
+	const float screenPerUnit = scale * frustum.projectionScale / depth;
+	const float limit = settings.maxScreenError * settings.bias;
+
+	for (uint32_t level = lodCount - 1; level > 0; level--) {
+		const float error = lods[level].error * screenPerUnit;
+		const float levelLimit = level > current ? limit * (1.0f - settings.hysteresis) : limit;
+
+		if (error <= levelLimit) return level;
+	}
+	return 0;
+}
+
+glm::vec4 culling::transformSphere(const Bounds& bounds, const glm::mat4x3& model) {
+	const glm::vec3 center = model * glm::vec4(bounds.center, 1.0f);
+
+	/*
+		The largest stretch is the square root of the largest eigenvalue of the gram matrix of
+		the columns, which is at most its largest absolute row sum. Without shear the columns
+		are orthogonal and that is the longest column, with shear the longest column is too small.
+	*/
+	const float g01 = std::abs(glm::dot(model[0], model[1]));
+	const float g02 = std::abs(glm::dot(model[0], model[2]));
+	const float g12 = std::abs(glm::dot(model[1], model[2]));
+	const float scale = std::sqrt(std::max({
+		glm::dot(model[0], model[0]) + g01 + g02,
+		glm::dot(model[1], model[1]) + g01 + g12,
+		glm::dot(model[2], model[2]) + g02 + g12
+	}));
+
+	return glm::vec4(center, bounds.radius * scale);
+}
\ No newline at end of file
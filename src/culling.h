@@ -0,0 +1,86 @@
+/*
+	Tests world space bounding spheres against the view frustum and rejects the ones
+	too small on screen to matter, 4 spheres at a time with SSE or one by one.
+
+	Spheres crossing a plane can be tested again with their box, which is tighter for
+	long thin meshes.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "modelManager/bounds.h"
+#include "modelManager/lod.h"
+
+
+/* objects whose bounding sphere covers less of the viewport height are culled */
+constexpr float MIN_SCREEN_SIZE = 0.002f;
+/* the simplification error may cover this much of the viewport height */
+constexpr float LOD_MAX_SCREEN_ERROR = 0.001f;
+
+/* bias scales the allowed error, above 1 picks coarser levels, a coarser level than the current
+   one is only picked when its error is a hysteresis fraction below the limit, so it doesn't pop back and forth */
+struct lodSettings {
+	float maxScreenError = LOD_MAX_SCREEN_ERROR;
+	float bias = 1.0f;
+	float hysteresis = 0.2f;
+};
+
+namespace culling {
+	/* every array holds at least `count` values */
+	struct spheres {
+		const float* x; const float* y; const float* z;
+		const float* radius;
+	};
+
+	struct frustum {
+		/* normalized, pointing inside */
+		std::array<glm::vec4, 6> planes;
+		/* the view space depth of a point is dot(depth, point) + depth.w */
+		glm::vec4 depth;
+		/* spheres with radius < sizePerDepth * depth are too small */
+		float sizePerDepth;
+		/* the part of the viewport height a length of 1 covers at depth 1 */
+		float projectionScale;
+	};
+
+	enum class result : uint8_t {
+		Outside, TooSmall, Intersecting, Inside,
+		/* in the frustum, but behind the occluders */
+		Occluded
+	};
+
+	/* left, right, bottom, top, near, far of the matrix's clip space, normalized and pointing inside */
+	std::array<glm::vec4, 6> extractPlanes(const glm::mat4& viewProjection);
+	frustum makeFrustum(const std::array<glm::vec4, 6>& planes, const glm::mat4& view, const glm::mat4& projection, float minScreenSize);
+
+	/* writes a result per sphere to out */
+	void testSpheres(const frustum& frustum, const spheres& in, size_t count, result* out);
+	/* the bounds are transformed by model, false if the box is fully outside a plane */
+	bool testBox(const frustum& frustum, const Bounds& bounds, const glm::mat4x3& model);
+
+	/* the center and the radius of the bounding sphere after the model transform, the radius holds under shear */
+	glm::vec4 transformSphere(const Bounds& bounds, const glm::mat4x3& model);
+
+	/* the coarsest level whose error is small enough on screen, scale is the world size of a mesh unit */
+	uint32_t selectLod(const frustum& frustum, const lodSettings& settings, const MeshLod* lods, uint32_t lodCount, uint32_t current, float scale, float depth);
+}
+
+struct cullStats {
+	/* the entities whose leaf in the bounds tree touches the frustum */
+	uint32_t tested = 0;
+	uint32_t visible = 0;
+	/* outside the frustum, by the sphere or the box */
+	uint32_t frustumCulled = 0;
+	uint32_t smallCulled = 0;
+	uint32_t occlusionCulled = 0;
+	/* drawn into the occlusion buffer */
+	uint32_t occluderTriangles = 0;
+	/* visible entities by level of detail */
+	std::array<uint32_t, MAX_MESH_LODS> lods{};
+};
\ No newline at end of file
@@ -8,6 +8,16 @@
 #include "comps/transform.h"
 #include "comps/rotatedByKeyboard.h"
 #include "comps/light.h"
+#include "comps/shadowCaster.h"
+#include "hierarchy.h"
+
+/* the entity and the meshes of its model cast shadows from the static cache */
+static void markStaticCaster(const std::shared_ptr<entt::registry>& registry, entt::entity entity) {
+	registry->emplace<comps::staticShadowCaster>(entity);
+	hierarchy::forEachDescendant(*registry, entity, [&registry](entt::entity descendant) {
+		registry->emplace<comps::staticShadowCaster>(descendant);
+	});
+}
 
 entt::entity factories::createTree(
 	const std::shared_ptr<entt::registry>& registry,
@@ -19,9 +29,11 @@ entt::entity factories::createTree(
 	registry->emplace<comps::position>(tree, pos);
 	registry->emplace<comps::orientation>(tree);
 	registry->emplace<comps::scale>(tree, scale);
-	registry->emplace<comps::transform>(tree);
+	registry->emplace<comps::localTransform>(tree);
+	registry->emplace<comps::worldTransform>(tree);
 
 	modelMngr->CreateInstance(tree, "tree");
+	markStaticCaster(registry, tree);
 
 	return tree;
 }
@@ -41,9 +53,11 @@ entt::entity factories::createTemple(
 	registry->emplace<comps::orientation>(temple, z * x * y);
 
 	registry->emplace<comps::scale>(temple, scale);
-	registry->emplace<comps::transform>(temple);
+	registry->emplace<comps::localTransform>(temple);
+	registry->emplace<comps::worldTransform>(temple);
 
 	modelMngr->CreateInstance(temple, "temple");
+	markStaticCaster(registry, temple);
 
 	return temple;
 }
@@ -64,7 +78,8 @@ entt::entity factories::createSphere(
 	registry->emplace<comps::orientation>(sphere, z * x * y);
 
 	registry->emplace<comps::scale>(sphere, scale);
-	registry->emplace<comps::transform>(sphere);
+	registry->emplace<comps::localTransform>(sphere);
+	registry->emplace<comps::worldTransform>(sphere);
 
 	modelMngr->CreateInstance(sphere, "sphere");
 
@@ -88,5 +103,49 @@ entt::entity factories::createDirLight(
 	glm::quat z = glm::angleAxis(glm::radians(roll), VEC_FORWARD);
 	registry->emplace<comps::orientation>(light, z * y * x);
 
+	return light;
+}
+
+/* local lights take their position and direction from the world transform, so they can be children */
+static void emplaceLightTransform(const std::shared_ptr<entt::registry>& registry, entt::entity light, glm::vec3 pos, glm::quat orient) {
+	registry->emplace<comps::position>(light, pos);
+	registry->emplace<comps::orientation>(light, orient);
+	registry->emplace<comps::scale>(light);
+	registry->emplace<comps::localTransform>(light);
+	registry->emplace<comps::worldTransform>(light);
+}
+
+entt::entity factories::createPointLight(
+	const std::shared_ptr<entt::registry>& registry,
+	const Color::RGB& color,
+	float ambient, float diffuse, float specular,
+	glm::vec3 pos, float range
+) {
+	auto light = registry->create();
+
+	registry->emplace<comps::lightEmitter>(light, color, ambient, diffuse, specular);
+	registry->emplace<comps::pointLight>(light, range);
+	emplaceLightTransform(registry, light, pos, glm::angleAxis(0.0f, VEC_UP));
+
+	return light;
+}
+
+entt::entity factories::createSpotLight(
+	const std::shared_ptr<entt::registry>& registry,
+	const Color::RGB& color,
+	float ambient, float diffuse, float specular,
+	glm::vec3 pos, float yaw, float pitch, float roll,
+	float range, float innerAngle, float outerAngle
+) {
+	auto light = registry->create();
+
+	registry->emplace<comps::lightEmitter>(light, color, ambient, diffuse, specular);
+	registry->emplace<comps::spotLight>(light, range, innerAngle, outerAngle);
+
+	glm::quat y = glm::angleAxis(glm::radians(yaw), VEC_UP);
+	glm::quat x = glm::angleAxis(glm::radians(pitch), VEC_RIGHT);
+	glm::quat z = glm::angleAxis(glm::radians(roll), VEC_FORWARD);
+	emplaceLightTransform(registry, light, pos, z * y * x);
+
 	return light;
 }
\ No newline at end of file
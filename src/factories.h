@@ -33,4 +33,20 @@ namespace factories {
 		float ambient, float diffuse, float specular,
 		float yaw, float pitch, float roll
 	);
+
+	entt::entity createPointLight(
+		const std::shared_ptr<entt::registry>& registry,
+		const Color::RGB& color,
+		float ambient, float diffuse, float specular,
+		glm::vec3 pos, float range
+	);
+
+	// the cone points down, rotated like createDirLight, the angles are in degrees from its axis
+	entt::entity createSpotLight(
+		const std::shared_ptr<entt::registry>& registry,
+		const Color::RGB& color,
+		float ambient, float diffuse, float specular,
+		glm::vec3 pos, float yaw, float pitch, float roll,
+		float range, float innerAngle, float outerAngle
+	);
 }
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "glDebug.h"
+
+#if GL_DEBUG_ENABLED
+
+#include <iostream>
+
+#include <glad/glad.h>
+
+
+/* messages without a GL_CHECK around the call report the last checked one, which is still a hint */
+static thread_local const char* callSiteCall = "unknown call";
+static thread_local const char* callSiteFile = "";
+static thread_local int callSiteLine = 0;
+
+static bool useCallback = false;
+
+static const char* sourceName(GLenum source) {
+	switch (source) {
+	case GL_DEBUG_SOURCE_API: return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION: return "application";
+	default: return "other";
+	}
+}
+
+static const char* typeName(GLenum type) {
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behavior";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	case GL_DEBUG_TYPE_MARKER: return "marker";
+	default: return "other";
+	}
+}
+
+static const char* severityName(GLenum severity) {
+	switch (severity) {
+	case GL_DEBUG_SEVERITY_HIGH: return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+	case GL_DEBUG_SEVERITY_LOW: return "low";
+	default: return "notification";
+	}
+}
+
+static void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei /*length*/, const GLchar* message, const void* /*userParam*/) {
+	std::cerr << "OpenGL " << typeName(type) << " (" << sourceName(source) << ", " << severityName(severity) << ", " << id << "): "
+		<< message << "\n\tat " << callSiteCall << " in " << callSiteFile << ":" << callSiteLine << std::endl;
+}
+
+void glDebug::init() {
+	if (!GLAD_GL_KHR_debug) {
+		std::cerr << "KHR_debug isn't available, OpenGL errors are checked with glGetError" << std::endl;
+		return;
+	}
+
+	glEnable(GL_DEBUG_OUTPUT);
+	/* the callback runs inside the failing call, so the call site is still the right one */
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(&debugCallback, nullptr);
+	/* notifications are mostly the driver describing buffer placements */
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+
+	useCallback = true;
+}
+
+void glDebug::setCallSite(const char* call, const char* file, int line) {
+	callSiteCall = call;
+	callSiteFile = file;
+	callSiteLine = line;
+}
+
+void glDebug::check() {
+	if (useCallback) return;
+
+	for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError()) {
+		std::cerr << "OpenGL error " << error << "\n\tat " << callSiteCall << " in " << callSiteFile << ":" << callSiteLine << std::endl;
+	}
+}
+
+#endif
\ No newline at end of file
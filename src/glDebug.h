@@ -0,0 +1,41 @@
+/*
+	OpenGL error checking.
+
+	GL_CHECK(call) runs the call and reports the errors it caused with the call, the
+	file and the line. With KHR_debug the driver reports them through a synchronous
+	message callback, which also catches performance and undefined behaviour warnings,
+	otherwise glGetError is read after the call.
+
+	It is on in debug builds and in builds defining ENABLE_GL_DEBUG, everywhere else
+	GL_CHECK is just the call and nothing queries the driver.
+*/
+
+#pragma once
+
+#if defined(_DEBUG) || defined(ENABLE_GL_DEBUG)
+#define GL_DEBUG_ENABLED 1
+#else
+#define GL_DEBUG_ENABLED 0
+#endif
+
+#if GL_DEBUG_ENABLED
+
+namespace glDebug {
+	/* call after the context is created and glad is loaded */
+	void init();
+
+	/* the call the debug messages are reported for */
+	void setCallSite(const char* call, const char* file, int line);
+	/* reads glGetError if the callback isn't available */
+	void check();
+}
+
+#define GL_DEBUG_INIT() glDebug::init()
+#define GL_CHECK(call) do { glDebug::setCallSite(#call, __FILE__, __LINE__); call; glDebug::check(); } while (0)
+
+#else
+
+#define GL_DEBUG_INIT() ((void)0)
+#define GL_CHECK(call) call
+
+#endif
\ No newline at end of file
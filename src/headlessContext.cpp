@@ -0,0 +1,150 @@
+#include "headlessContext.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <SDL2/SDL.h>
+
+#include "glDebug.h"
+
+
+PFNEGLGETPROCADDRESSPROC HeadlessContext::getProcAddress = nullptr;
+
+HeadlessContext::HeadlessContext()
+	: library(nullptr)
+	, display(EGL_NO_DISPLAY)
+	, context(EGL_NO_CONTEXT)
+	, surface(EGL_NO_SURFACE)
+	, terminateDisplay(nullptr)
+	, destroyContext(nullptr)
+	, destroySurface(nullptr)
+	, makeCurrent(nullptr)
+{
+#ifdef _WIN32
+	library = SDL_LoadObject("libEGL.dll");
+#else
+	library = SDL_LoadObject("libEGL.so.1");
+	if (!library) library = SDL_LoadObject("libEGL.so");
+#endif
+	if (!library) {
+		throw std::runtime_error(std::string("Headless rendering needs EGL, which could not be loaded: ") + SDL_GetError());
+	}
+
+	try {
+		const auto getDisplay = (PFNEGLGETDISPLAYPROC)loadFunction("eglGetDisplay");
+		const auto initialize = (PFNEGLINITIALIZEPROC)loadFunction("eglInitialize");
+		const auto queryString = (PFNEGLQUERYSTRINGPROC)loadFunction("eglQueryString");
+		const auto bindApi = (PFNEGLBINDAPIPROC)loadFunction("eglBindAPI");
+		const auto chooseConfig = (PFNEGLCHOOSECONFIGPROC)loadFunction("eglChooseConfig");
+		const auto createContext = (PFNEGLCREATECONTEXTPROC)loadFunction("eglCreateContext");
+		const auto createPbufferSurface = (PFNEGLCREATEPBUFFERSURFACEPROC)loadFunction("eglCreatePbufferSurface");
+		terminateDisplay = (PFNEGLTERMINATEPROC)loadFunction("eglTerminate");
+		destroyContext = (PFNEGLDESTROYCONTEXTPROC)loadFunction("eglDestroyContext");
+		destroySurface = (PFNEGLDESTROYSURFACEPROC)loadFunction("eglDestroySurface");
+		makeCurrent = (PFNEGLMAKECURRENTPROC)loadFunction("eglMakeCurrent");
+		getProcAddress = (PFNEGLGETPROCADDRESSPROC)loadFunction("eglGetProcAddress");
+
+		display = openDisplay(getDisplay);
+		if (display == EGL_NO_DISPLAY || !initialize(display, nullptr, nullptr)) {
+			display = EGL_NO_DISPLAY;
+			throw std::runtime_error("No EGL display to render headless on.");
+		}
+
+		/* desktop GL, the shaders are #version 410 core */
+		if (!bindApi(EGL_OPENGL_API)) {
+			throw std::runtime_error("The EGL driver can't create desktop OpenGL contexts.");
+		}
+
+		const EGLint configAttribs[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint configCount = 0;
+		if (!chooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+			throw std::runtime_error("No EGL config supports OpenGL pbuffers.");
+		}
+
+		const EGLint contextAttribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 1,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#if GL_DEBUG_ENABLED
+			/* drivers report much more in debug contexts */
+			EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+			EGL_NONE
+		};
+		context = createContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+		if (context == EGL_NO_CONTEXT) {
+			throw std::runtime_error("Error creating the OpenGL 4.1 core context with EGL.");
+		}
+
+		/* everything renders into the render target, the default framebuffer is never used */
+		const char* extensions = queryString(display, EGL_EXTENSIONS);
+		if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context")) {
+			const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			surface = createPbufferSurface(display, config, pbufferAttribs);
+			if (surface == EGL_NO_SURFACE) {
+				throw std::runtime_error("Error creating the EGL pbuffer surface.");
+			}
+		}
+
+		if (!makeCurrent(display, surface, surface, context)) {
+			throw std::runtime_error("Error making the headless EGL context current.");
+		}
+	}
+	catch (...) {
+		release();
+		throw;
+	}
+}
+
+HeadlessContext::~HeadlessContext() {
+	release();
+}
+
+void* HeadlessContext::loadFunction(const char* name) {
+	void* function = SDL_LoadFunction(library, name);
+	if (!function) {
+		throw std::runtime_error(std::string("The EGL library has no ") + name + ".");
+	}
+	return function;
+}
+
+EGLDisplay HeadlessContext::openDisplay(PFNEGLGETDISPLAYPROC getDisplay) {
+	/* Mesa's surfaceless platform needs no window system at all, e.g. on a build server */
+	const auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)getProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay) {
+		const EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		if (surfaceless != EGL_NO_DISPLAY) return surfaceless;
+	}
+
+	return getDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+void HeadlessContext::release() {
+	if (display != EGL_NO_DISPLAY) {
+		makeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (surface != EGL_NO_SURFACE) destroySurface(display, surface);
+		if (context != EGL_NO_CONTEXT) destroyContext(display, context);
+		terminateDisplay(display);
+	}
+	display = EGL_NO_DISPLAY;
+	context = EGL_NO_CONTEXT;
+	surface = EGL_NO_SURFACE;
+
+	getProcAddress = nullptr;
+	if (library) SDL_UnloadObject(library);
+	library = nullptr;
+}
+
+void* HeadlessContext::GetProcAddress(const char* name) {
+	return (void*)getProcAddress(name);
+}
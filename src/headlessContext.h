@@ -0,0 +1,43 @@
+/*
+	An OpenGL 4.1 core context without a window, made with EGL on a surfaceless display
+	(or a 1x1 pbuffer where surfaceless contexts aren't supported).
+	EGL is loaded at runtime, so the app doesn't link against it and throws only when it is missing.
+*/
+
+#pragma once
+
+#include <SDL2/SDL_egl.h>
+
+
+class HeadlessContext {
+private:
+	void* library;
+
+	EGLDisplay display;
+	EGLContext context;
+	EGLSurface surface;
+
+	PFNEGLTERMINATEPROC terminateDisplay;
+	PFNEGLDESTROYCONTEXTPROC destroyContext;
+	PFNEGLDESTROYSURFACEPROC destroySurface;
+	PFNEGLMAKECURRENTPROC makeCurrent;
+
+	/* the loader of the current context for GetProcAddress, glad takes a plain function */
+	static PFNEGLGETPROCADDRESSPROC getProcAddress;
+
+	void* loadFunction(const char* name);
+	EGLDisplay openDisplay(PFNEGLGETDISPLAYPROC getDisplay);
+	/* frees whatever was created so far, the constructor does it before throwing */
+	void release();
+
+public:
+	/* loads EGL and makes the context current, throws if any of it fails */
+	HeadlessContext();
+	~HeadlessContext();
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	/* for gladLoadGLLoader */
+	static void* GetProcAddress(const char* name);
+};
@@ -0,0 +1,128 @@
+#include "hierarchy.h"
+
+#include <stdexcept>
+#include <vector>
+
+
+namespace {
+	uint32_t depthOf(const entt::registry& registry, entt::entity entity) {
+		const comps::child* child = registry.try_get<comps::child>(entity);
+		return child ? child->depth : 0;
+	}
+
+	/* removes the entity from its parent's list of children, the child component stays */
+	void unlink(entt::registry& registry, entt::entity entity) {
+		comps::child& child = registry.get<comps::child>(entity);
+		if (child.parent == entt::null) return;
+
+		comps::parent& parent = registry.get<comps::parent>(child.parent);
+
+		if (child.prevSibling != entt::null) {
+			registry.get<comps::child>(child.prevSibling).nextSibling = child.nextSibling;
+		}
+		else {
+			parent.firstChild = child.nextSibling;
+		}
+
+		if (child.nextSibling != entt::null) {
+			registry.get<comps::child>(child.nextSibling).prevSibling = child.prevSibling;
+		}
+
+		parent.childCount--;
+
+		child.parent = entt::null;
+		child.prevSibling = entt::null;
+		child.nextSibling = entt::null;
+	}
+
+	void updateDescendantDepths(entt::registry& registry, entt::entity entity) {
+		hierarchy::forEachDescendant(registry, entity, [&registry](entt::entity descendant) {
+			comps::child& child = registry.get<comps::child>(descendant);
+			child.depth = depthOf(registry, child.parent) + 1;
+		});
+	}
+
+	void detachChild(entt::registry& registry, entt::entity entity) {
+		if (!registry.all_of<comps::child>(entity)) return;
+
+		/* notifies the listeners before the relation is gone, removing unlinks it */
+		registry.patch<comps::child>(entity);
+		registry.remove<comps::child>(entity);
+
+		updateDescendantDepths(registry, entity);
+	}
+
+	void onChildDestroyed(entt::registry& registry, entt::entity entity) {
+		unlink(registry, entity);
+	}
+
+	/* the children of a destroyed parent become roots */
+	void onParentDestroyed(entt::registry& registry, entt::entity entity) {
+		entt::entity curr = registry.get<comps::parent>(entity).firstChild;
+
+		while (curr != entt::null) {
+			const entt::entity next = registry.get<comps::child>(curr).nextSibling;
+			detachChild(registry, curr);
+			curr = next;
+		}
+	}
+}
+
+void hierarchy::init(const std::shared_ptr<entt::registry>& registry) {
+	registry->on_destroy<comps::child>().connect<&onChildDestroyed>();
+	registry->on_destroy<comps::parent>().connect<&onParentDestroyed>();
+}
+
+void hierarchy::setParent(const std::shared_ptr<entt::registry>& registry, entt::entity entity, entt::entity parent) {
+	if (entity == parent || isAncestor(*registry, entity, parent)) {
+		throw std::runtime_error("Entity parent-child hierarchy is circular.");
+	}
+
+	if (registry->all_of<comps::child>(entity)) {
+		unlink(*registry, entity);
+	}
+	else {
+		registry->emplace<comps::child>(entity);
+	}
+
+	comps::parent& parentComp = registry->get_or_emplace<comps::parent>(parent);
+	comps::child& child = registry->get<comps::child>(entity);
+
+	/* prepend to the parent's children */
+	if (parentComp.firstChild != entt::null) {
+		registry->get<comps::child>(parentComp.firstChild).prevSibling = entity;
+	}
+	child.nextSibling = parentComp.firstChild;
+	parentComp.firstChild = entity;
+	parentComp.childCount++;
+
+	child.parent = parent;
+	child.depth = depthOf(*registry, parent) + 1;
+
+	/* notifies the listeners about the new parent */
+	registry->patch<comps::child>(entity);
+
+	updateDescendantDepths(*registry, entity);
+}
+
+void hierarchy::detach(const std::shared_ptr<entt::registry>& registry, entt::entity entity) {
+	detachChild(*registry, entity);
+}
+
+void hierarchy::destroy(const std::shared_ptr<entt::registry>& registry, entt::entity entity) {
+	std::vector<entt::entity> subtree;
+	forEachDescendant(*registry, entity, [&subtree](entt::entity descendant) {
+		subtree.push_back(descendant);
+	});
+
+	/* children first, so no entity is orphaned on the way */
+	registry->destroy(subtree.rbegin(), subtree.rend());
+	registry->destroy(entity);
+}
+
+bool hierarchy::isAncestor(const entt::registry& registry, entt::entity ancestor, entt::entity entity) {
+	for (const comps::child* child = registry.try_get<comps::child>(entity); child && child->parent != entt::null; child = registry.try_get<comps::child>(child->parent)) {
+		if (child->parent == ancestor) return true;
+	}
+	return false;
+}
\ No newline at end of file
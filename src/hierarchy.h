@@ -0,0 +1,67 @@
+/*
+	Parent-child relations between entities.
+
+	Every parent knows its first child and the children are linked through their
+	siblings, so a subtree can be walked without touching the rest of the scene.
+	Use the functions below instead of emplacing comps::child directly, they keep
+	the links and the depths valid and the hierarchy acyclic.
+*/
+
+#pragma once
+
+#include <memory>
+
+#include <entt/entt.hpp>
+
+#include "comps/child.h"
+
+
+namespace hierarchy {
+	/* connects the signals that keep the links valid when entities are destroyed */
+	void init(const std::shared_ptr<entt::registry>& registry);
+
+	/* throws if the parent is the entity itself or one of its descendants */
+	void setParent(const std::shared_ptr<entt::registry>& registry, entt::entity entity, entt::entity parent);
+	/* makes the entity a root, its subtree stays attached to it */
+	void detach(const std::shared_ptr<entt::registry>& registry, entt::entity entity);
+	/* destroys the entity together with all its descendants */
+	void destroy(const std::shared_ptr<entt::registry>& registry, entt::entity entity);
+
+	bool isAncestor(const entt::registry& registry, entt::entity ancestor, entt::entity entity);
+
+	/* calls func(entity) for every descendant, parents before their children */
+	template <class Func>
+	void forEachDescendant(const entt::registry& registry, entt::entity entity, Func&& func);
+}
+
+template <class Func>
+void hierarchy::forEachDescendant(const entt::registry& registry, entt::entity entity, Func&& func) {
+	const comps::parent* root = registry.try_get<comps::parent>(entity);
+	if (!root || root->firstChild == entt::null) return;
+
+	auto& parents = registry.storage<comps::parent>();
+	auto& children = registry.storage<comps::child>();
+
+	entt::entity curr = root->firstChild;
+
+	/* depth-first walk over the links, without a stack */
+	while (curr != entity) {
+		func(curr);
+
+		if (parents.contains(curr) && parents.get(curr).firstChild != entt::null) {
+			curr = parents.get(curr).firstChild;
+			continue;
+		}
+
+		/* climb until there is a sibling to move to or the subtree is done */
+		while (curr != entity) {
+			const comps::child& child = children.get(curr);
+
+			if (child.nextSibling != entt::null) {
+				curr = child.nextSibling;
+				break;
+			}
+			curr = child.parent;
+		}
+	}
+}
\ No newline at end of file
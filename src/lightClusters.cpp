@@ -0,0 +1,294 @@
+#include "lightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "glDebug.h"
+#include "profiler.h"
+
+
+/* preparing a light is a transform and a few divisions */
+constexpr size_t LIGHT_GRAIN_SIZE = 1024;
+/* the cosine of 45 degrees, wider cones are bounded around their base */
+constexpr float WIDE_CONE_COS = 0.70710678f;
+
+LightClusters::LightClusters()
+	: projection(0.0f)
+	, clusterMin(CLUSTER_COUNT)
+	, clusterMax(CLUSTER_COUNT)
+	, near(0.0f)
+	, far(0.0f)
+	, sliceScale(0.0f)
+	, sliceBias(0.0f)
+	, clusterLights(CLUSTER_COUNT)
+	, grid(CLUSTER_COUNT, glm::uvec2(0))
+	, maxTexels(0)
+{
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+
+	createTextureBuffer(lightBuffer, lightTexture, GL_RGBA32F);
+	createTextureBuffer(gridBuffer, gridTexture, GL_RG32UI);
+	createTextureBuffer(indexBuffer, indexTexture, GL_R16UI);
+}
+
+LightClusters::~LightClusters() {
+	const GLuint buffers[] = { lightBuffer, gridBuffer, indexBuffer };
+	const GLuint textures[] = { lightTexture, gridTexture, indexTexture };
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+}
+
+void LightClusters::createTextureBuffer(GLuint& buffer, GLuint& texture, GLenum format) {
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	/* the texture keeps reading the buffer when its store is reallocated */
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	GL_CHECK(glTexBuffer(GL_TEXTURE_BUFFER, format, buffer));
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::upload(GLuint buffer, const void* data, GLsizeiptr size) {
+	/* orphaned every frame, so the driver doesn't wait for the draws of the last one */
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	GL_CHECK(glBufferData(GL_TEXTURE_BUFFER, std::max<GLsizeiptr>(size, 16), nullptr, GL_STREAM_DRAW));
+	if (size > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::buildClusterBoxes(const Camera& camera) {
+	projection = camera.getProjection();
+	near = camera.getZNear();
+	far = camera.getZFar();
+
+	const float logRatio = std::log(far / near);
+	sliceScale = CLUSTER_GRID_Z / logRatio;
+	sliceBias = -(CLUSTER_GRID_Z * std::log(near)) / logRatio;
+
+	const glm::mat4 inverseProjection = glm::inverse(projection);
+
+	for (uint32_t y = 0; y < CLUSTER_GRID_Y; y++) {
+		for (uint32_t x = 0; x < CLUSTER_GRID_X; x++) {
+			/* the corners of the tile on the near plane, the ones at depth d are them times d / near */
+			std::array<glm::vec3, 4> corners;
+			for (int i = 0; i < 4; i++) {
+				const float ndcX = -1.0f + 2.0f * float(x + (i & 1)) / CLUSTER_GRID_X;
+				const float ndcY = -1.0f + 2.0f * float(y + (i >> 1)) / CLUSTER_GRID_Y;
+				const glm::vec4 corner = inverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+				corners[i] = glm::vec3(corner) / corner.w;
+			}
+
+			for (uint32_t z = 0; z < CLUSTER_GRID_Z; z++) {
+				const float sliceNear = near * std::pow(far / near, float(z) / CLUSTER_GRID_Z);
+				const float sliceFar = near * std::pow(far / near, float(z + 1) / CLUSTER_GRID_Z);
+
+				glm::vec3 min(std::numeric_limits<float>::max());
+				glm::vec3 max(-std::numeric_limits<float>::max());
+				for (const glm::vec3& corner : corners) {
+					min = glm::min(min, glm::min(corner * (sliceNear / near), corner * (sliceFar / near)));
+					max = glm::max(max, glm::max(corner * (sliceNear / near), corner * (sliceFar / near)));
+				}
+
+				const uint32_t cluster = (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+				clusterMin[cluster] = min;
+				clusterMax[cluster] = max;
+			}
+		}
+	}
+}
+
+uint32_t LightClusters::sliceOf(float depth) const {
+	const float slice = std::floor(std::log(depth) * sliceScale + sliceBias);
+	return static_cast<uint32_t>(std::clamp(slice, 0.0f, float(CLUSTER_GRID_Z - 1)));
+}
+
+/* the first and the last tile the range of normalized device coordinates touches */
+static bool tileRange(float minNdc, float maxNdc, uint32_t tiles, uint32_t& first, uint32_t& last) {
+	if (maxNdc < -1.0f || minNdc > 1.0f) return false;
+
+	const float scale = 0.5f * tiles;
+	first = static_cast<uint32_t>(std::clamp(std::floor((minNdc + 1.0f) * scale), 0.0f, float(tiles - 1)));
+	last = static_cast<uint32_t>(std::clamp(std::floor((maxNdc + 1.0f) * scale), 0.0f, float(tiles - 1)));
+	return true;
+}
+
+void LightClusters::prepareLight(uint32_t index, const localLight& light, const glm::mat4& view) {
+	const glm::vec3 position = glm::vec3(view * glm::vec4(light.position, 1.0f));
+	const glm::vec3 direction = glm::mat3(view) * light.direction;
+
+	/* the shaders light in view space */
+	glm::vec4* data = lightData.data() + index * LIGHT_DATA_TEXELS;
+	data[0] = glm::vec4(position, light.range);
+	data[1] = glm::vec4(light.color, light.ambient);
+	data[2] = glm::vec4(direction, light.cosOuter);
+	data[3] = glm::vec4(light.diffuse, light.specular, light.cosInner, 0.0f);
+
+	lightBounds& b = bounds[index];
+	b.center = position;
+	b.radius = light.range;
+
+	/* the sphere around a cone is centered on its axis, cones wider than a half space leave
+	   any such sphere and keep the one around the position, so do the point lights */
+	if (light.cosOuter >= 0.0f) {
+		if (light.cosOuter < WIDE_CONE_COS) {
+			b.center = position + direction * (light.range * light.cosOuter);
+			b.radius = light.range * std::sqrt(1.0f - light.cosOuter * light.cosOuter);
+		}
+		else {
+			b.radius = light.range / (2.0f * light.cosOuter);
+			b.center = position + direction * b.radius;
+		}
+	}
+
+	/* the camera looks down -z */
+	const float minDepth = -b.center.z - b.radius;
+	const float maxDepth = -b.center.z + b.radius;
+	b.visible = maxDepth >= near && minDepth <= far;
+	if (!b.visible) return;
+
+	b.minZ = sliceOf(std::max(minDepth, near));
+	b.maxZ = sliceOf(std::min(maxDepth, far));
+
+	/* the x / depth of the sphere's box is the largest and the smallest at its corners */
+	const float depths[] = { std::max(minDepth, near), std::max(maxDepth, near) };
+	float minX = std::numeric_limits<float>::max(), maxX = -minX;
+	float minY = minX, maxY = -minX;
+	for (float depth : depths) {
+		for (float side : { -1.0f, 1.0f }) {
+			const float ndcX = projection[0][0] * (b.center.x + side * b.radius) / depth - projection[2][0];
+			const float ndcY = projection[1][1] * (b.center.y + side * b.radius) / depth - projection[2][1];
+			minX = std::min(minX, ndcX);
+			maxX = std::max(maxX, ndcX);
+			minY = std::min(minY, ndcY);
+			maxY = std::max(maxY, ndcY);
+		}
+	}
+
+	b.visible = tileRange(minX, maxX, CLUSTER_GRID_X, b.minX, b.maxX) && tileRange(minY, maxY, CLUSTER_GRID_Y, b.minY, b.maxY);
+}
+
+void LightClusters::assignSlice(uint32_t slice) {
+	const uint32_t first = slice * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+	for (uint32_t cluster = first; cluster < first + CLUSTER_GRID_X * CLUSTER_GRID_Y; cluster++) {
+		clusterLights[cluster].clear();
+	}
+
+	for (uint32_t index : sliceLights[slice]) {
+		const lightBounds& b = bounds[index];
+		const float radiusSquared = b.radius * b.radius;
+
+		for (uint32_t y = b.minY; y <= b.maxY; y++) {
+			for (uint32_t x = b.minX; x <= b.maxX; x++) {
+				const uint32_t cluster = first + y * CLUSTER_GRID_X + x;
+
+				const glm::vec3 closest = glm::clamp(b.center, clusterMin[cluster], clusterMax[cluster]);
+				const glm::vec3 offset = closest - b.center;
+				if (glm::dot(offset, offset) <= radiusSquared) {
+					clusterLights[cluster].push_back(static_cast<uint16_t>(index));
+				}
+			}
+		}
+	}
+}
+
+void LightClusters::packLists() {
+	indices.clear();
+
+	for (uint32_t cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+		const std::vector<uint16_t>& list = clusterLights[cluster];
+		if (list.size() > MAX_LIGHTS_PER_CLUSTER) stats.overflowing++;
+
+		/* the texture buffer can't hold more */
+		const size_t room = static_cast<size_t>(maxTexels) - indices.size();
+		const size_t count = std::min({ list.size(), size_t(MAX_LIGHTS_PER_CLUSTER), room });
+
+		grid[cluster] = glm::uvec2(static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(count));
+		indices.insert(indices.end(), list.begin(), list.begin() + count);
+
+		stats.maxPerCluster = std::max(stats.maxPerCluster, static_cast<uint32_t>(list.size()));
+	}
+
+	stats.indices = static_cast<uint32_t>(indices.size());
+}
+
+void LightClusters::Build(const Camera& camera, const std::vector<localLight>& lights, const std::shared_ptr<ThreadPool>& threadPool) {
+	PROFILE_SCOPE("LightClusters::Build");
+
+	if (camera.getProjection() != projection || camera.getZNear() != near || camera.getZFar() != far) {
+		buildClusterBoxes(camera);
+	}
+
+	const uint32_t count = static_cast<uint32_t>(std::min<size_t>({ lights.size(), MAX_LOCAL_LIGHTS, static_cast<size_t>(maxTexels) / LIGHT_DATA_TEXELS }));
+	stats = {};
+	stats.lights = count;
+
+	bounds.resize(count);
+	lightData.resize(static_cast<size_t>(count) * LIGHT_DATA_TEXELS);
+
+	const glm::mat4 view = camera.getView();
+
+	/* every job writes only the slots of its lights */
+	threadPool->ParallelFor(count, LIGHT_GRAIN_SIZE, [&](size_t begin, size_t end) {
+		PROFILE_SCOPE("LightClusters::prepare job");
+
+		for (size_t i = begin; i < end; i++) {
+			prepareLight(static_cast<uint32_t>(i), lights[i], view);
+		}
+	});
+
+	for (std::vector<uint32_t>& list : sliceLights) {
+		list.clear();
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		if (!bounds[i].visible) continue;
+		for (uint32_t z = bounds[i].minZ; z <= bounds[i].maxZ; z++) sliceLights[z].push_back(i);
+	}
+
+	/* a slice owns its froxels, so no two jobs write the same list */
+	threadPool->ParallelFor(CLUSTER_GRID_Z, 1, [this](size_t begin, size_t end) {
+		PROFILE_SCOPE("LightClusters::assign job");
+
+		for (size_t slice = begin; slice < end; slice++) {
+			assignSlice(static_cast<uint32_t>(slice));
+		}
+	});
+
+	packLists();
+}
+
+void LightClusters::Upload() {
+	PROFILE_SCOPE("LightClusters::Upload");
+
+	upload(lightBuffer, lightData.data(), lightData.size() * sizeof(glm::vec4));
+	upload(gridBuffer, grid.data(), grid.size() * sizeof(glm::uvec2));
+	upload(indexBuffer, indices.data(), indices.size() * sizeof(uint16_t));
+}
+
+void LightClusters::Bind() const {
+	glActiveTexture(GL_TEXTURE0 + LIGHT_DATA_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+	glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+	glActiveTexture(GL_TEXTURE0 + LIGHT_INDICES_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+clustersBlock LightClusters::GetBlock() const {
+	clustersBlock block{};
+	block.gridX = CLUSTER_GRID_X;
+	block.gridY = CLUSTER_GRID_Y;
+	block.gridZ = CLUSTER_GRID_Z;
+	block.lightCount = stats.lights;
+	block.sliceScale = sliceScale;
+	block.sliceBias = sliceBias;
+	return block;
+}
+
+const clusterStats& LightClusters::GetStats() const {
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+/*
+	Clustered forward lighting of the point and spot lights.
+
+	The view frustum is split into a grid of froxels, CLUSTER_GRID_X x CLUSTER_GRID_Y
+	tiles of the screen and CLUSTER_GRID_Z slices of exponentially growing depth. Every
+	frame the lights are moved into view space and bounded by a sphere, the spheres are
+	bucketed into the slices they touch and every slice tests its lights against the
+	boxes of its froxels, a job per slice, so the workers never write the same list.
+
+	The lists are packed into one array of light indices, the grid keeps the offset and
+	the count of every froxel. The lights, the grid and the indices are uploaded into
+	texture buffers, so a fragment only loops over the lights of its froxel.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "threadPool.h"
+#include "uniformBuffers.h"
+
+
+constexpr uint32_t CLUSTER_GRID_X = 16;
+constexpr uint32_t CLUSTER_GRID_Y = 9;
+constexpr uint32_t CLUSTER_GRID_Z = 24;
+constexpr uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+/* the lights past this many in a froxel are dropped */
+constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 256;
+/* the lights past this many in the scene are ignored */
+constexpr uint32_t MAX_LOCAL_LIGHTS = 16384;
+/* a light takes 4 RGBA32F texels of the light data */
+constexpr uint32_t LIGHT_DATA_TEXELS = 4;
+
+/* a point or spot light in world space, collected from the registry */
+struct localLight {
+	glm::vec3 position;
+	float range;
+	/* normalized, only used by spot lights */
+	glm::vec3 direction;
+	/* the cosines of the angles from the direction, the light fades from inner to outer,
+	   point lights use -1 and -2, which every direction is inside of */
+	float cosInner;
+	float cosOuter;
+
+	glm::vec3 color;
+	float ambient;
+	float diffuse;
+	float specular;
+};
+
+struct clusterStats {
+	uint32_t lights = 0;
+	/* the length of all lists together */
+	uint32_t indices = 0;
+	uint32_t maxPerCluster = 0;
+	/* froxels with more than MAX_LIGHTS_PER_CLUSTER lights */
+	uint32_t overflowing = 0;
+};
+
+class LightClusters {
+private:
+	/* a light in view space, the slices and the tiles its sphere may touch */
+	struct lightBounds {
+		glm::vec3 center;
+		float radius;
+		uint32_t minX, maxX;
+		uint32_t minY, maxY;
+		uint32_t minZ, maxZ;
+		bool visible;
+	};
+
+	/* the view space box of every froxel, rebuilt when the projection changes */
+	glm::mat4 projection;
+	std::vector<glm::vec3> clusterMin;
+	std::vector<glm::vec3> clusterMax;
+	float near;
+	float far;
+	float sliceScale;
+	float sliceBias;
+
+	std::vector<lightBounds> bounds;
+	/* the lights whose sphere reaches into each slice */
+	std::array<std::vector<uint32_t>, CLUSTER_GRID_Z> sliceLights;
+	/* the list of each froxel, written by the job of its slice */
+	std::vector<std::vector<uint16_t>> clusterLights;
+
+	/* what is uploaded */
+	std::vector<glm::vec4> lightData;
+	std::vector<glm::uvec2> grid;
+	std::vector<uint16_t> indices;
+
+	GLuint lightBuffer, gridBuffer, indexBuffer;
+	GLuint lightTexture, gridTexture, indexTexture;
+	GLint maxTexels;
+
+	clusterStats stats;
+
+	static void createTextureBuffer(GLuint& buffer, GLuint& texture, GLenum format);
+	static void upload(GLuint buffer, const void* data, GLsizeiptr size);
+
+	void buildClusterBoxes(const Camera& camera);
+	uint32_t sliceOf(float depth) const;
+	/* writes the bounds and the light data of the light */
+	void prepareLight(uint32_t index, const localLight& light, const glm::mat4& view);
+	void assignSlice(uint32_t slice);
+	void packLists();
+
+public:
+	LightClusters();
+	~LightClusters();
+
+	LightClusters(const LightClusters&) = delete;
+	LightClusters& operator=(const LightClusters&) = delete;
+
+	/* assigns the lights to the froxels of the camera, only the packing of the lists runs on the calling thread */
+	void Build(const Camera& camera, const std::vector<localLight>& lights, const std::shared_ptr<ThreadPool>& threadPool);
+	/* writes the texture buffers, call on the GL thread after Build */
+	void Upload();
+	/* binds the texture buffers to their texture units */
+	void Bind() const;
+
+	clustersBlock GetBlock() const;
+	const clusterStats& GetStats() const;
+};
\ No newline at end of file
@@ -1,19 +1,53 @@
 #include "app.h"
 #include <iostream>
+#include <cstring>
+#include <string>
 
+#include "transformKernel.h"
 
-int runApp();
+
+int runApp(int argc, char** argv);
+int runHeadless(int argc, char** argv);
+bool parseLodArgument(int argc, char** argv, int& arg, lodSettings& lods);
 
 int main(int argc, char** argv) {
-	(void)argc;
-	(void)argv;
+	if (argc > 1 && std::strcmp(argv[1], "--bench-transforms") == 0) {
+		transformKernel::benchmark(100000, 20);
+		return 0;
+	}
+	if (argc > 1 && std::strcmp(argv[1], "--headless") == 0) {
+		return runHeadless(argc, argv);
+	}
 
-	return runApp();
+	return runApp(argc, argv);
 }
 
-int runApp() {
+/* --lod-error e, --lod-bias b and --lod-hysteresis h set the fields of lodSettings, false for other arguments */
+bool parseLodArgument(int argc, char** argv, int& arg, lodSettings& lods) {
+	if (arg + 1 >= argc) return false;
+
+	if (std::strcmp(argv[arg], "--lod-error") == 0) lods.maxScreenError = std::stof(argv[++arg]);
+	else if (std::strcmp(argv[arg], "--lod-bias") == 0) lods.bias = std::stof(argv[++arg]);
+	else if (std::strcmp(argv[arg], "--lod-hysteresis") == 0) lods.hysteresis = std::stof(argv[++arg]);
+	else return false;
+
+	return true;
+}
+
+/* [--lod-error e] [--lod-bias b] [--lod-hysteresis h] */
+int runApp(int argc, char** argv) {
 	try {
+		lodSettings lods;
+
+		for (int arg = 1; arg < argc; arg++) {
+			if (!parseLodArgument(argc, argv, arg, lods)) {
+				std::cerr << "Unknown argument " << argv[arg] << std::endl;
+				return 1;
+			}
+		}
+
 		std::unique_ptr<App> app = std::make_unique<App>(600, 600);
+		app->setLodSettings(lods);
 		app->run();
 	}
 	catch (const std::exception& e) {
@@ -21,5 +55,44 @@ int runApp() {
 		return 1;
 	}
 
+	return 0;
+}
+
+/* --headless [frames] [--capture-every n] [--size width height] [--output dir] and the level of detail arguments of runApp */
+int runHeadless(int argc, char** argv) {
+	try {
+		headlessSettings settings;
+		lodSettings lods;
+		int width = 600, height = 600;
+
+		int arg = 2;
+		if (arg < argc && argv[arg][0] != '-') settings.frames = std::stoul(argv[arg++]);
+
+		for (; arg < argc; arg++) {
+			if (std::strcmp(argv[arg], "--capture-every") == 0 && arg + 1 < argc) {
+				settings.captureEvery = std::stoul(argv[++arg]);
+			}
+			else if (std::strcmp(argv[arg], "--size") == 0 && arg + 2 < argc) {
+				width = std::stoi(argv[++arg]);
+				height = std::stoi(argv[++arg]);
+			}
+			else if (std::strcmp(argv[arg], "--output") == 0 && arg + 1 < argc) {
+				settings.outputDir = argv[++arg];
+			}
+			else if (!parseLodArgument(argc, argv, arg, lods)) {
+				std::cerr << "Unknown headless argument " << argv[arg] << std::endl;
+				return 1;
+			}
+		}
+
+		std::unique_ptr<App> app = std::make_unique<App>(width, height, true);
+		app->setLodSettings(lods);
+		app->runHeadless(settings);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
 	return 0;
 }
\ No newline at end of file
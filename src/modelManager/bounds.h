@@ -0,0 +1,14 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+
+/* in the space of the mesh */
+struct Bounds {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	/* the sphere is centered on the box, its radius reaches the farthest vertex */
+	glm::vec3 center;
+	float radius;
+};
\ No newline at end of file
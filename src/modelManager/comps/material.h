@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include "../../color.h"
 
 namespace comps {
@@ -8,12 +10,15 @@ namespace comps {
 		Color diffuse;
 		Color specular;
 		float shininess;
+		/* the same for every entity using the material, 0 if it isn't shared */
+		uint32_t id;
 
-		inline colorMaterial(const Color& ambient, const Color& diffuse, const Color& specular, float shininess)
+		inline colorMaterial(const Color& ambient, const Color& diffuse, const Color& specular, float shininess, uint32_t id = 0)
 			: ambient(ambient)
 			, diffuse(diffuse)
 			, specular(specular)
 			, shininess(shininess)
+			, id(id)
 		{}
 
 		inline colorMaterial() : colorMaterial(Color::RGB(0.0f), Color::RGB(0.0f), Color::RGB(0.0f), 1.0f) {}
@@ -1,14 +1,36 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+
 #include <glad/glad.h>
 
+#include "../bounds.h"
+#include "../lod.h"
+
 
 namespace comps {
+	/* a range of a geometry arena, drawn with the base vertex and the first index */
 	struct mesh {
 		GLuint vao;
-		GLuint vbo;
-		GLuint ebo;
 		GLsizei elementCount;
 		GLenum indexType;
+
+		GLint baseVertex;
+		GLuint firstIndex;
+		/* the handle of the arena allocation */
+		uint32_t geometry;
+
+		/* used for culling */
+		Bounds bounds;
+
+		/* elementCount and firstIndex are the ones of level 0 */
+		std::array<MeshLod, MAX_MESH_LODS> lods;
+		uint32_t lodCount;
+	};
+
+	/* the level of detail drawn last frame */
+	struct lodLevel {
+		uint32_t level = 0;
 	};
 }
\ No newline at end of file
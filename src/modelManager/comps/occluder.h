@@ -0,0 +1,13 @@
+#pragma once
+
+#include <memory>
+
+#include "../../occlusion.h"
+
+
+namespace comps {
+	/* the entity hides what's behind it, drawn into the occlusion buffer with the coarsest level of its mesh */
+	struct occluder {
+		std::shared_ptr<const occluderMesh> mesh;
+	};
+}
\ No newline at end of file
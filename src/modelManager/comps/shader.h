@@ -1,19 +1,42 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <array>
 #include <unordered_map>
 #include <string>
 
 
+/* the plain uniforms the renderer sets, found by name when the program is linked,
+   the per draw data comes from uniform blocks bound by offset */
+enum class Uniform {
+	/* the cascade the shadow program draws into */
+	LightViewProj,
+	/* the samplers are set to their texture units when the program is linked */
+	ShadowMap,
+	LightData,
+	ClusterGrid,
+	LightIndices,
+	Count
+};
+
+/* by Uniform, -1 for the uniforms the program doesn't use */
+using uniformLocations = std::array<GLint, (size_t)Uniform::Count>;
+
 namespace comps {
 	struct shader {
 		GLuint program;
+		uniformLocations locations;
+
+		/* the same shader reading the model and normal matrices per instance, 0 if there is none */
+		GLuint instancedProgram;
+		uniformLocations instancedLocations;
 
-		GLint modelUnifLoc;
-		GLint viewUnifLoc;
-		GLint projUnifLoc;
-		GLint normalUnifLoc;
+		inline GLint location(Uniform uniform) const {
+			return locations[(size_t)uniform];
+		}
 
-		bool requireLights;
+		inline GLint instancedLocation(Uniform uniform) const {
+			return instancedLocations[(size_t)uniform];
+		}
 	};
 }
\ No newline at end of file
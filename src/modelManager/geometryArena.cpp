@@ -0,0 +1,243 @@
+#include "geometryArena.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../glDebug.h"
+#include "../profiler.h"
+
+
+GeometryArena::GeometryArena(GLsizei vertexSize, GLenum indexType, void (*setupAttributes)(GLsizei vertexSize), uint32_t vertexCapacity, uint32_t indexCapacity)
+	: vbo(0)
+	, ebo(0)
+	, vertexSize(vertexSize)
+	, indexType(indexType)
+	, indexSize(indexType == GL_UNSIGNED_INT ? 4 : indexType == GL_UNSIGNED_SHORT ? 2 : 1)
+	, setupAttributes(setupAttributes)
+	, vertexCapacity(vertexCapacity)
+	, indexCapacity(indexCapacity)
+	, freeVertices{ { 0, vertexCapacity } }
+	, freeIndices{ { 0, indexCapacity } }
+{
+	glGenVertexArrays(1, &vao);
+	glGenVertexArrays(1, &positionVao);
+
+	attachBuffers(createBuffer((GLsizeiptr)vertexCapacity * vertexSize), createBuffer((GLsizeiptr)indexCapacity * indexSize));
+}
+
+GeometryArena::~GeometryArena() {
+	glDeleteVertexArrays(1, &vao);
+	glDeleteVertexArrays(1, &positionVao);
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ebo);
+}
+
+bool GeometryArena::allocateRange(std::vector<range>& freeRanges, uint32_t size, uint32_t& offset) {
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); it++) {
+		if (it->size < size) continue;
+
+		offset = it->offset;
+		it->offset += size;
+		it->size -= size;
+
+		if (it->size == 0) freeRanges.erase(it);
+		return true;
+	}
+	return false;
+}
+
+void GeometryArena::freeRange(std::vector<range>& freeRanges, uint32_t offset, uint32_t size) {
+	if (size == 0) return;
+
+	auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset, [](const range& r, uint32_t o) { return r.offset < o; });
+	auto it = freeRanges.insert(next, { offset, size });
+
+	/* merge with the neighbours */
+	if (it + 1 != freeRanges.end() && it->offset + it->size == (it + 1)->offset) {
+		it->size += (it + 1)->size;
+		freeRanges.erase(it + 1);
+	}
+	if (it != freeRanges.begin() && (it - 1)->offset + (it - 1)->size == it->offset) {
+		(it - 1)->size += it->size;
+		freeRanges.erase(it);
+	}
+}
+
+GLuint GeometryArena::createBuffer(GLsizeiptr size) {
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+GLuint GeometryArena::copyIntoNewBuffer(GLuint buffer, GLsizeiptr size, GLsizeiptr newSize) {
+	GLuint newBuffer = createBuffer(newSize);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	GL_CHECK(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	return newBuffer;
+}
+
+void GeometryArena::attachBuffers(GLuint newVbo, GLuint newEbo) {
+	if (newVbo != vbo) glDeleteBuffers(1, &vbo);
+	if (newEbo != ebo) glDeleteBuffers(1, &ebo);
+	vbo = newVbo;
+	ebo = newEbo;
+
+	/* the vao keeps its name, so nothing outside the arena notices the new buffers */
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	setupAttributes(vertexSize);
+
+	glBindVertexArray(positionVao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertexSize, nullptr);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GeometryArena::grow(uint32_t vertices, uint32_t indices) {
+	PROFILE_SCOPE("GeometryArena::grow");
+
+	GLuint newVbo = vbo, newEbo = ebo;
+
+	/* the offsets stay the same, the old content is copied as a whole */
+	if (vertices > 0) {
+		const uint32_t newCapacity = std::max(vertexCapacity * 2, vertexCapacity + vertices);
+		newVbo = copyIntoNewBuffer(vbo, (GLsizeiptr)vertexCapacity * vertexSize, (GLsizeiptr)newCapacity * vertexSize);
+
+		freeRange(freeVertices, vertexCapacity, newCapacity - vertexCapacity);
+		vertexCapacity = newCapacity;
+	}
+	if (indices > 0) {
+		const uint32_t newCapacity = std::max(indexCapacity * 2, indexCapacity + indices);
+		newEbo = copyIntoNewBuffer(ebo, (GLsizeiptr)indexCapacity * indexSize, (GLsizeiptr)newCapacity * indexSize);
+
+		freeRange(freeIndices, indexCapacity, newCapacity - indexCapacity);
+		indexCapacity = newCapacity;
+	}
+
+	attachBuffers(newVbo, newEbo);
+}
+
+uint32_t GeometryArena::Allocate(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount) {
+	uint32_t vertexOffset, indexOffset;
+
+	if (!allocateRange(freeVertices, vertexCount, vertexOffset)) {
+		grow(vertexCount, 0);
+		allocateRange(freeVertices, vertexCount, vertexOffset);
+	}
+	if (!allocateRange(freeIndices, indexCount, indexOffset)) {
+		grow(0, indexCount);
+		allocateRange(freeIndices, indexCount, indexOffset);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+	GL_CHECK(glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)vertexOffset * vertexSize, (GLsizeiptr)vertexCount * vertexSize, vertices));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+	GL_CHECK(glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)indexOffset * indexSize, (GLsizeiptr)indexCount * indexSize, indices));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	const geometryAllocation allocation = { (GLint)vertexOffset, indexOffset, (GLsizei)vertexCount, (GLsizei)indexCount };
+
+	if (!freeHandles.empty()) {
+		uint32_t handle = freeHandles.back();
+		freeHandles.pop_back();
+
+		allocations[handle] = allocation;
+		live[handle] = true;
+		return handle;
+	}
+
+	allocations.push_back(allocation);
+	live.push_back(true);
+	return static_cast<uint32_t>(allocations.size() - 1);
+}
+
+void GeometryArena::Free(uint32_t handle) {
+	if (handle >= allocations.size() || !live[handle]) {
+		throw std::runtime_error("Freeing a geometry allocation which doesn't exist.");
+	}
+
+	const geometryAllocation& allocation = allocations[handle];
+	freeRange(freeVertices, allocation.baseVertex, allocation.vertexCount);
+	freeRange(freeIndices, allocation.firstIndex, allocation.indexCount);
+
+	live[handle] = false;
+	freeHandles.push_back(handle);
+}
+
+const geometryAllocation& GeometryArena::Get(uint32_t handle) const {
+	return allocations.at(handle);
+}
+
+void GeometryArena::Compact() {
+	PROFILE_SCOPE("GeometryArena::Compact");
+
+	std::vector<uint32_t> handles;
+	for (uint32_t handle = 0; handle < allocations.size(); handle++) {
+		if (live[handle]) handles.push_back(handle);
+	}
+
+	GLuint newVbo = createBuffer((GLsizeiptr)vertexCapacity * vertexSize);
+	GLuint newEbo = createBuffer((GLsizeiptr)indexCapacity * indexSize);
+
+	/* copied in the old order, so nearby meshes stay nearby */
+	std::sort(handles.begin(), handles.end(), [this](uint32_t a, uint32_t b) { return allocations[a].baseVertex < allocations[b].baseVertex; });
+
+	uint32_t vertexEnd = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVbo);
+	for (uint32_t handle : handles) {
+		geometryAllocation& allocation = allocations[handle];
+		GL_CHECK(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)allocation.baseVertex * vertexSize, (GLintptr)vertexEnd * vertexSize, (GLsizeiptr)allocation.vertexCount * vertexSize));
+		allocation.baseVertex = (GLint)vertexEnd;
+		vertexEnd += allocation.vertexCount;
+	}
+
+	std::sort(handles.begin(), handles.end(), [this](uint32_t a, uint32_t b) { return allocations[a].firstIndex < allocations[b].firstIndex; });
+
+	uint32_t indexEnd = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, ebo);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newEbo);
+	for (uint32_t handle : handles) {
+		geometryAllocation& allocation = allocations[handle];
+		GL_CHECK(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)allocation.firstIndex * indexSize, (GLintptr)indexEnd * indexSize, (GLsizeiptr)allocation.indexCount * indexSize));
+		allocation.firstIndex = indexEnd;
+		indexEnd += allocation.indexCount;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	freeVertices.clear();
+	freeIndices.clear();
+	freeRange(freeVertices, vertexEnd, vertexCapacity - vertexEnd);
+	freeRange(freeIndices, indexEnd, indexCapacity - indexEnd);
+
+	attachBuffers(newVbo, newEbo);
+}
+
+GLuint GeometryArena::GetVao() const {
+	return vao;
+}
+
+GLuint GeometryArena::GetPositionVao() const {
+	return positionVao;
+}
+
+GLenum GeometryArena::GetIndexType() const {
+	return indexType;
+}
+
+GLsizei GeometryArena::GetIndexSize() const {
+	return indexSize;
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+/*
+	Big vertex and index buffers of a single vertex format, shared by many meshes.
+
+	Every mesh gets a range of vertices and a range of indices and is drawn with its
+	base vertex and first index, so all the meshes of the arena share one VAO. The
+	buffers grow when they run out of space, freed ranges are reused (first fit) and
+	Compact moves the live ranges to the front of the buffers.
+
+	Allocations are addressed by handles which stay the same for their whole life,
+	their offsets change only in Compact.
+
+	A second VAO reads only the positions, the first 3 floats of every vertex format,
+	for depth only passes.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+
+struct geometryAllocation {
+	GLint baseVertex;
+	GLuint firstIndex;
+	GLsizei vertexCount;
+	GLsizei indexCount;
+};
+
+class GeometryArena {
+private:
+	/* in elements, sorted by offset, never touching each other */
+	struct range {
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	GLuint vao;
+	GLuint positionVao;
+	GLuint vbo;
+	GLuint ebo;
+
+	GLsizei vertexSize;
+	GLenum indexType;
+	GLsizei indexSize;
+	/* sets the vertex attributes of the format for the bound GL_ARRAY_BUFFER */
+	void (*setupAttributes)(GLsizei vertexSize);
+
+	uint32_t vertexCapacity;
+	uint32_t indexCapacity;
+	std::vector<range> freeVertices;
+	std::vector<range> freeIndices;
+
+	std::vector<geometryAllocation> allocations;
+	std::vector<bool> live;
+	std::vector<uint32_t> freeHandles;
+
+	static bool allocateRange(std::vector<range>& freeRanges, uint32_t size, uint32_t& offset);
+	static void freeRange(std::vector<range>& freeRanges, uint32_t offset, uint32_t size);
+
+	static GLuint createBuffer(GLsizeiptr size);
+	static GLuint copyIntoNewBuffer(GLuint buffer, GLsizeiptr size, GLsizeiptr newSize);
+	/* deletes the replaced buffers and points the vao at the new ones */
+	void attachBuffers(GLuint newVbo, GLuint newEbo);
+	void grow(uint32_t vertices, uint32_t indices);
+
+public:
+	GeometryArena(GLsizei vertexSize, GLenum indexType, void (*setupAttributes)(GLsizei vertexSize), uint32_t vertexCapacity, uint32_t indexCapacity);
+	~GeometryArena();
+
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	/* copies the data into the arena and returns the handle of the allocation */
+	uint32_t Allocate(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount);
+	void Free(uint32_t handle);
+	const geometryAllocation& Get(uint32_t handle) const;
+
+	/* moves every allocation to the start of the buffers, leaving one free range at the end */
+	void Compact();
+
+	GLuint GetVao() const;
+	/* position only at location 0, for depth only passes */
+	GLuint GetPositionVao() const;
+	GLenum GetIndexType() const;
+	GLsizei GetIndexSize() const;
+};
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include "glModelManager.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
-#include "../comps/child.h"
+#include "../hierarchy.h"
+#include "../profiler.h"
+#include "../uniformBuffers.h"
 #include "../comps/position.h"
 #include "../comps/orientation.h"
 #include "../comps/scale.h"
@@ -12,32 +16,75 @@
 GLModelManager::GLModelManager(std::shared_ptr<entt::registry> registry, std::shared_ptr<IntermediateModelManager> intermediateMngr)
 	: registry(registry)
 	, intermediateMngr(intermediateMngr)
+	, geometry(std::make_unique<GeometryArena>(static_cast<GLsizei>(sizeof(Vertex)), GL_UNSIGNED_SHORT, &setupVertexAttributes, GEOMETRY_ARENA_VERTICES, GEOMETRY_ARENA_INDICES))
 {}
 
 GLModelManager::~GLModelManager() {}
 
 
 void GLModelManager::CreateInstance(entt::entity parent, const Model& model) {
+	PROFILE_SCOPE("GLModelManager::CreateInstance");
 
 	for (const auto& [meshId, materialId] : model.materialPerMesh) {
 		shaderId_t shaderId = model.shaderPerMesh.at(meshId);
 	
 		entt::entity entity = registry->create();
 
-		registry->emplace<comps::child>(entity, parent);
+		hierarchy::setParent(registry, entity, parent);
 
 		registry->emplace<comps::position>(entity);
 		registry->emplace<comps::orientation>(entity);
 		registry->emplace<comps::scale>(entity);
-		registry->emplace<comps::transform>(entity);
+		registry->emplace<comps::localTransform>(entity);
+		registry->emplace<comps::worldTransform>(entity);
+		registry->emplace<comps::normalTransform>(entity);
+		registry->emplace<comps::lodLevel>(entity);
 
 		emplaceMesh(entity, { model.objectId, meshId });
 		emplaceMaterial(entity, materialId);
 		emplaceShader(entity, shaderId);
+
+		if (model.occluders.find(meshId) != model.occluders.end()) {
+			emplaceOccluder(entity, { model.objectId, meshId });
+		}
+	}
+}
+
+void GLModelManager::DestroyInstance(entt::entity parent) {
+	PROFILE_SCOPE("GLModelManager::DestroyInstance");
+
+	hierarchy::destroy(registry, parent);
+}
+
+void GLModelManager::UnloadModel(const Model& model) {
+	PROFILE_SCOPE("GLModelManager::UnloadModel");
+
+	for (const auto& [meshId, shaderId] : model.shaderPerMesh) {
+		freeMesh({ model.objectId, meshId });
+	}
+}
+
+void GLModelManager::CompactGeometry() {
+	PROFILE_SCOPE("GLModelManager::CompactGeometry");
+
+	geometry->Compact();
+
+	/* the meshes and the entities keep copies of the offsets */
+	for (auto& [meshId, mesh] : meshes) {
+		const geometryAllocation& allocation = geometry->Get(mesh.geometry);
+		mesh.baseVertex = allocation.baseVertex;
+		mesh.firstIndex = allocation.firstIndex;
+	}
+	for (auto [entity, mesh] : registry->view<comps::mesh>().each()) {
+		const geometryAllocation& allocation = geometry->Get(mesh.geometry);
+		mesh.baseVertex = allocation.baseVertex;
+		mesh.firstIndex = allocation.firstIndex;
 	}
 }
 
 void GLModelManager::PrepareModel(const Model& model) {
+	PROFILE_SCOPE("GLModelManager::PrepareModel");
+
 	for (const auto& [meshId, shaderId] : model.shaderPerMesh) {
 		ensureMeshCreated({ model.objectId, meshId });
 		ensureShaderCreated(shaderId);
@@ -48,6 +95,14 @@ const id_umap<shaderId_t, comps::shader>& GLModelManager::GetShaders() const {
 	return shaders;
 }
 
+const comps::shader& GLModelManager::GetShader(const shaderId_t& shaderId) {
+	return getOrCreateShader(shaderId);
+}
+
+GLuint GLModelManager::GetPositionVao() const {
+	return geometry->GetPositionVao();
+}
+
 
 /////////////////////////////////////////////////////////////////////////////////////////
 /*      SHADER                                                                         */
@@ -59,6 +114,8 @@ void GLModelManager::emplaceShader(entt::entity entity, const shaderId_t& shader
 }
 
 GLuint GLModelManager::compileShader(const std::filesystem::path& path, GLenum shaderType) {
+	PROFILE_SCOPE("GLModelManager::compileShader");
+
 	std::string strShader;
 	std::ifstream shaderFile;
 
@@ -135,11 +192,13 @@ GLuint GLModelManager::compileShader(const std::filesystem::path& path, GLenum s
 	return shader;
 }
 
-void GLModelManager::linkShader(comps::shader& shader, const Shader& originalShader) {
+GLuint GLModelManager::linkProgram(const std::filesystem::path& vertex, const Shader& originalShader) {
+	PROFILE_SCOPE("GLModelManager::linkProgram");
+
 	std::vector<GLuint> glShaders{};
 
-	if (originalShader.vertex != "") {
-		glShaders.push_back(compileShader(originalShader.vertex, GL_VERTEX_SHADER));
+	if (vertex != "") {
+		glShaders.push_back(compileShader(vertex, GL_VERTEX_SHADER));
 	}
 	if (originalShader.geometry != "") {
 		glShaders.push_back(compileShader(originalShader.geometry, GL_GEOMETRY_SHADER));
@@ -148,23 +207,23 @@ void GLModelManager::linkShader(comps::shader& shader, const Shader& originalSha
 		glShaders.push_back(compileShader(originalShader.fragment, GL_FRAGMENT_SHADER));
 	}
 
-	shader.program = glCreateProgram();
+	GLuint program = glCreateProgram();
 
 	for (GLuint glShader : glShaders) {
-		glAttachShader(shader.program, glShader);
+		glAttachShader(program, glShader);
 	}
 
-	glLinkProgram(shader.program);
+	glLinkProgram(program);
 
 	// error handling
 	GLint status;
-	glGetProgramiv(shader.program, GL_LINK_STATUS, &status);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) {
 		GLint infoLogLength;
-		glGetProgramiv(shader.program, GL_INFO_LOG_LENGTH, &infoLogLength);
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
 
 		GLchar* infoLog = new GLchar[(size_t)infoLogLength + 1];
-		glGetProgramInfoLog(shader.program, infoLogLength, NULL, infoLog);
+		glGetProgramInfoLog(program, infoLogLength, NULL, infoLog);
 
 		std::cerr << "Linker failure:" << std::endl << infoLog << std::endl;
 
@@ -172,11 +231,76 @@ void GLModelManager::linkShader(comps::shader& shader, const Shader& originalSha
 	}
 
 	for (GLuint glShader : glShaders) {
-		glDetachShader(shader.program, glShader);
+		glDetachShader(program, glShader);
+	}
+
+	return program;
+}
+
+void GLModelManager::linkShader(comps::shader& shader, const Shader& originalShader) {
+	shader.program = linkProgram(originalShader.vertex, originalShader);
+	reflectUniforms(shader.program, shader.locations);
+
+	if (originalShader.vertexInstanced != "") {
+		shader.instancedProgram = linkProgram(originalShader.vertexInstanced, originalShader);
+		reflectUniforms(shader.instancedProgram, shader.instancedLocations);
+	}
+	else {
+		shader.instancedProgram = 0;
+		shader.instancedLocations.fill(-1);
+	}
+}
+
+/* the name and type of every Uniform in the shaders, in the order of the enum */
+struct uniformInfo {
+	const char* name;
+	GLenum type;
+};
+
+constexpr std::array<uniformInfo, (size_t)Uniform::Count> UNIFORM_INFOS = { {
+	{ "lightViewProj", GL_FLOAT_MAT4 },
+	{ "shadowMap", GL_SAMPLER_2D_ARRAY_SHADOW },
+	{ "lightData", GL_SAMPLER_BUFFER },
+	{ "clusterGrid", GL_UNSIGNED_INT_SAMPLER_BUFFER },
+	{ "lightIndices", GL_UNSIGNED_INT_SAMPLER_BUFFER },
+} };
+
+void GLModelManager::reflectUniforms(GLuint program, uniformLocations& locations) {
+	locations.fill(-1);
+
+	GLint uniformCount = 0, maxNameLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	std::vector<GLchar> name((size_t)maxNameLength + 1);
+
+	for (GLint i = 0; i < uniformCount; i++) {
+		GLsizei length;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+		/* the members of uniform blocks have no location */
+		GLint location = glGetUniformLocation(program, name.data());
+		if (location == -1) continue;
+
+		for (size_t u = 0; u < UNIFORM_INFOS.size(); u++) {
+			if (std::strcmp(UNIFORM_INFOS[u].name, name.data()) != 0) continue;
+
+			if (UNIFORM_INFOS[u].type != type) {
+				std::cerr << "Uniform " << name.data() << " has an unexpected type, it won't be set." << std::endl;
+				break;
+			}
+
+			locations[u] = location;
+			break;
+		}
 	}
 }
 
 void GLModelManager::createShader(const shaderId_t& shaderId) {
+	PROFILE_SCOPE("GLModelManager::createShader");
+
 	const Shader& originalShader = intermediateMngr->GetShader(shaderId);
 
 	comps::shader shader{};
@@ -184,16 +308,33 @@ void GLModelManager::createShader(const shaderId_t& shaderId) {
 	// compile the program
 	linkShader(shader, originalShader);
 	
-	shader.modelUnifLoc = glGetUniformLocation(shader.program, "model");
-	shader.viewUnifLoc = glGetUniformLocation(shader.program, "view");
-	shader.projUnifLoc = glGetUniformLocation(shader.program, "proj");
-	shader.normalUnifLoc = glGetUniformLocation(shader.program, "normal");
-
-	shader.requireLights = true;
+	UniformBuffers::BindBlocks(shader.program);
+	bindSamplers(shader.program, shader.locations);
+	if (shader.instancedProgram != 0) {
+		UniformBuffers::BindBlocks(shader.instancedProgram);
+		bindSamplers(shader.instancedProgram, shader.instancedLocations);
+	}
 
 	shaders.emplace(shaderId, shader);
 }
 
+void GLModelManager::bindSamplers(GLuint program, const uniformLocations& locations) {
+	/* the texture units never change, so the samplers are set once */
+	constexpr std::pair<Uniform, GLuint> SAMPLER_UNITS[] = {
+		{ Uniform::ShadowMap, SHADOW_TEXTURE_UNIT },
+		{ Uniform::LightData, LIGHT_DATA_TEXTURE_UNIT },
+		{ Uniform::ClusterGrid, CLUSTER_GRID_TEXTURE_UNIT },
+		{ Uniform::LightIndices, LIGHT_INDICES_TEXTURE_UNIT },
+	};
+
+	glUseProgram(program);
+	for (const auto& [uniform, unit] : SAMPLER_UNITS) {
+		const GLint location = locations[(size_t)uniform];
+		if (location != -1) glUniform1i(location, unit);
+	}
+	glUseProgram(0);
+}
+
 void GLModelManager::ensureShaderCreated(const shaderId_t& shaderId) {
 	if (shaders.find(shaderId) == shaders.end())
 		createShader(shaderId);
@@ -212,9 +353,11 @@ const comps::shader& GLModelManager::getOrCreateShader(const shaderId_t& shaderI
 void GLModelManager::emplaceMaterial(entt::entity entity, const materialId_t& materialId) {
 	const Material& material = intermediateMngr->GetMaterial(materialId);
 
+	auto [it, inserted] = materialIds.try_emplace(materialId, static_cast<uint32_t>(materialIds.size() + 1));
+
 	switch (material.type) {
 	case MaterialType::Color:
-		emplaceColorMaterial(entity, material.color);
+		emplaceColorMaterial(entity, material.color, it->second);
 		
 		break;
 	case MaterialType::Texture:
@@ -226,8 +369,8 @@ void GLModelManager::emplaceMaterial(entt::entity entity, const materialId_t& ma
 	}
 }
 
-void GLModelManager::emplaceColorMaterial(entt::entity entity, const ColorData& colorData) {
-	registry->emplace<comps::colorMaterial>(entity, colorData.diffuse, colorData.diffuse, colorData.specular, colorData.shininess);
+void GLModelManager::emplaceColorMaterial(entt::entity entity, const ColorData& colorData, uint32_t id) {
+	registry->emplace<comps::colorMaterial>(entity, colorData.diffuse, colorData.diffuse, colorData.specular, colorData.shininess, id);
 }
 
 void GLModelManager::emplaceTextureMaterial(entt::entity entity, const TextureData& textureData) {
@@ -239,69 +382,57 @@ void GLModelManager::emplaceTextureMaterial(entt::entity entity, const TextureDa
 /////////////////////////////////////////////////////////////////////////////////////////
 
 void GLModelManager::emplaceMesh(entt::entity entity, const uniqueMeshId_t& meshId) {
-	const comps::mesh& mesh = getOrCreateMesh(meshId);
-	registry->emplace<comps::mesh>(entity, mesh.vao, mesh.vbo, mesh.ebo, mesh.elementCount, mesh.indexType);
+	registry->emplace<comps::mesh>(entity, getOrCreateMesh(meshId));
 }
 
 
-void GLModelManager::createMesh(const uniqueMeshId_t& meshId) {
-	const Mesh& originalMesh = intermediateMngr->GetObject(meshId.objectId).meshes.at(meshId.meshId);
-
-	comps::mesh mesh = {};
-
-	GLenum err;
-	while (glGetError() != GL_NO_ERROR);
-
-	// Generate GL objects
-	glGenVertexArrays(1, &mesh.vao);
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "glGenVertexArrays: OpenGL error: " << err << std::endl;
-	}
-
-	glGenBuffers(1, &mesh.vbo);
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "glGenBuffers: OpenGL error: " << err << std::endl;
-	}
-	glGenBuffers(1, &mesh.ebo);
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "glGenBuffers: OpenGL error: " << err << std::endl;
-	}
-
-	// Bind GL objects
-	glBindVertexArray(mesh.vao);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
-
-	// Buffer data
-	glBufferData(GL_ARRAY_BUFFER, originalMesh.vertices.size() * sizeof(Vertex), originalMesh.vertices.data(), GL_STATIC_DRAW);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, originalMesh.indices.size() * sizeof(GLushort), originalMesh.indices.data(), GL_STATIC_DRAW);
-	mesh.elementCount = static_cast<GLsizei>(originalMesh.indices.size());
-
-	// Setup Pointers
+void GLModelManager::setupVertexAttributes(GLsizei vertexSize) {
 	//   positions
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, vx)));
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<void*>(offsetof(Vertex, vx)));
 	//   normals
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, nx)));
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<void*>(offsetof(Vertex, nx)));
 	//   texture coordinates
 	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, tx)));
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, vertexSize, reinterpret_cast<void*>(offsetof(Vertex, tx)));
+}
 
-	// Unbind
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void GLModelManager::createMesh(const uniqueMeshId_t& meshId) {
+	PROFILE_SCOPE("GLModelManager::createMesh");
 
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "OpenGL error: " << err << std::endl;
-	}
+	const Mesh& originalMesh = intermediateMngr->GetObject(meshId.objectId).meshes.at(meshId.meshId);
 
-	mesh.indexType = GL_UNSIGNED_SHORT;
+	uint32_t handle = geometry->Allocate(
+		originalMesh.vertices.data(), static_cast<uint32_t>(originalMesh.vertices.size()),
+		originalMesh.indices.data(), static_cast<uint32_t>(originalMesh.indices.size())
+	);
+	const geometryAllocation& allocation = geometry->Get(handle);
+
+	comps::mesh mesh = {};
+	mesh.vao = geometry->GetVao();
+	mesh.elementCount = static_cast<GLsizei>(originalMesh.lods[0].indexCount);
+	mesh.indexType = geometry->GetIndexType();
+	mesh.baseVertex = allocation.baseVertex;
+	mesh.firstIndex = allocation.firstIndex;
+	mesh.geometry = handle;
+	mesh.bounds = originalMesh.bounds;
+
+	mesh.lodCount = static_cast<uint32_t>(std::min<size_t>(originalMesh.lods.size(), MAX_MESH_LODS));
+	std::copy_n(originalMesh.lods.begin(), mesh.lodCount, mesh.lods.begin());
 
 	meshes.emplace(meshId, mesh);
 }
 
+void GLModelManager::freeMesh(const uniqueMeshId_t& meshId) {
+	auto it = meshes.find(meshId);
+	if (it == meshes.end()) return;
+
+	geometry->Free(it->second.geometry);
+	meshes.erase(it);
+	occluders.erase(meshId);
+}
+
 void GLModelManager::ensureMeshCreated(const uniqueMeshId_t& meshId) {
 	if (meshes.find(meshId) == meshes.end())
 		createMesh(meshId);
@@ -310,4 +441,41 @@ void GLModelManager::ensureMeshCreated(const uniqueMeshId_t& meshId) {
 const comps::mesh& GLModelManager::getOrCreateMesh(const uniqueMeshId_t& meshId) {
 	ensureMeshCreated(meshId);
 	return meshes.at(meshId);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////
+/*      OCCLUDER                                                                       */
+/////////////////////////////////////////////////////////////////////////////////////////
+
+void GLModelManager::emplaceOccluder(entt::entity entity, const uniqueMeshId_t& meshId) {
+	registry->emplace<comps::occluder>(entity, getOrCreateOccluder(meshId));
+}
+
+const std::shared_ptr<const occluderMesh>& GLModelManager::getOrCreateOccluder(const uniqueMeshId_t& meshId) {
+	auto it = occluders.find(meshId);
+	if (it != occluders.end()) return it->second;
+
+	PROFILE_SCOPE("GLModelManager::createOccluder");
+
+	const Mesh& originalMesh = intermediateMngr->GetObject(meshId.objectId).meshes.at(meshId.meshId);
+	const MeshLod& coarsest = originalMesh.lods.back();
+
+	/* only the positions the coarsest level uses, numbered again */
+	auto occluder = std::make_shared<occluderMesh>();
+	std::vector<uint32_t> remap(originalMesh.vertices.size(), UINT32_MAX);
+
+	occluder->indices.reserve(coarsest.indexCount);
+	for (uint32_t i = coarsest.firstIndex; i < coarsest.firstIndex + coarsest.indexCount; i++) {
+		const uint16_t index = originalMesh.indices[i];
+
+		if (remap[index] == UINT32_MAX) {
+			const Vertex& vertex = originalMesh.vertices[index];
+			remap[index] = static_cast<uint32_t>(occluder->positions.size());
+			occluder->positions.emplace_back(vertex.vx, vertex.vy, vertex.vz);
+		}
+		occluder->indices.push_back(static_cast<uint16_t>(remap[index]));
+	}
+
+	return occluders.emplace(meshId, std::move(occluder)).first->second;
 }
\ No newline at end of file
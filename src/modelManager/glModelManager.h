@@ -10,42 +10,72 @@
 
 #include "comps/material.h"
 #include "comps/mesh.h"
+#include "comps/occluder.h"
 #include "comps/shader.h"
 
+#include "geometryArena.h"
+
 #include "intermediateModelManager.h"
 
+/* the initial size of the geometry arena, it grows when it runs out */
+constexpr uint32_t GEOMETRY_ARENA_VERTICES = 1 << 16;
+constexpr uint32_t GEOMETRY_ARENA_INDICES = 1 << 18;
+
 class GLModelManager {
 private:
 	std::shared_ptr<entt::registry> registry;
 	std::shared_ptr<IntermediateModelManager> intermediateMngr;
 
+	/* every mesh has the Vertex format, so they all share one arena */
+	std::unique_ptr<GeometryArena> geometry;
 	id_umap<uniqueMeshId_t, comps::mesh> meshes;
+	/* shared by the occluder components of the instances */
+	id_umap<uniqueMeshId_t, std::shared_ptr<const occluderMesh>> occluders;
 	id_umap<shaderId_t, comps::shader> shaders;
+	/* numbered from 1 so the renderer can tell materials apart without comparing them */
+	id_umap<materialId_t, uint32_t> materialIds;
 
 	void emplaceShader(entt::entity entity, const shaderId_t& shaderId);
 	void emplaceMesh(entt::entity entity, const uniqueMeshId_t& meshId);
 	void emplaceMaterial(entt::entity entity, const materialId_t& materialId);
 
-	void emplaceColorMaterial(entt::entity entity, const ColorData& colorData);
+	void emplaceColorMaterial(entt::entity entity, const ColorData& colorData, uint32_t id);
 	void emplaceTextureMaterial(entt::entity entity, const TextureData& textureData);
 
 	static GLuint compileShader(const std::filesystem::path& path, GLenum shaderType);
+	static GLuint linkProgram(const std::filesystem::path& vertex, const Shader& originalShader);
+	static void reflectUniforms(GLuint program, uniformLocations& locations);
+	static void bindSamplers(GLuint program, const uniformLocations& locations);
 	void linkShader(comps::shader& shader, const Shader& originalShader);
 	void createShader(const shaderId_t& shaderId);
 	void ensureShaderCreated(const shaderId_t& shaderId);
 	const comps::shader& getOrCreateShader(const shaderId_t& shaderId);
 
+	static void setupVertexAttributes(GLsizei vertexSize);
 	void createMesh(const uniqueMeshId_t& meshId);
+	void freeMesh(const uniqueMeshId_t& meshId);
 	void ensureMeshCreated(const uniqueMeshId_t& meshId);
 	const comps::mesh& getOrCreateMesh(const uniqueMeshId_t& meshId);
 
+	void emplaceOccluder(entt::entity entity, const uniqueMeshId_t& meshId);
+	const std::shared_ptr<const occluderMesh>& getOrCreateOccluder(const uniqueMeshId_t& meshId);
+
 public:
 	GLModelManager(std::shared_ptr<entt::registry> registry, std::shared_ptr<IntermediateModelManager> intermediateMngr);
 	~GLModelManager();
 
 	void CreateInstance(entt::entity parent, const Model& model);
+	/* destroys the parent together with the entities created for it */
+	void DestroyInstance(entt::entity parent);
 
 	void PrepareModel(const Model& model);
+	/* frees the meshes of the model, its instances have to be destroyed before */
+	void UnloadModel(const Model& model);
+	/* moves the meshes to the start of the arena buffers and updates every comps::mesh */
+	void CompactGeometry();
 
 	const id_umap<shaderId_t, comps::shader>& GetShaders() const;
+	/* the shader has to be loaded by the intermediate manager */
+	const comps::shader& GetShader(const shaderId_t& shaderId);
+	GLuint GetPositionVao() const;
 };
@@ -16,6 +16,7 @@ The ID of each object is the same as the path from the base directory without th
 #include <string>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <rapidjson/document.h>
 
@@ -84,6 +85,9 @@ struct HashId {
 template <class T_Id, class T_Val>
 using id_umap = std::unordered_map<T_Id, T_Val, HashId<T_Id>, CompareId<T_Id>>;
 
+template <class T_Id>
+using id_uset = std::unordered_set<T_Id, HashId<T_Id>, CompareId<T_Id>>;
+
 
 // file handling
 template <class T_Id> struct fileParamethers { static std::filesystem::path directory; static std::string extension; };
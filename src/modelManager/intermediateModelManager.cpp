@@ -4,8 +4,11 @@
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 
 #include "../hashHelper.h"
+#include "../profiler.h"
+#include "simplifier.h"
 
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -21,7 +24,46 @@ IntermediateModelManager::~IntermediateModelManager() {}
 /*      OBJECT & MESH                                                                  */
 /////////////////////////////////////////////////////////////////////////////////////////
 
+Bounds IntermediateModelManager::computeBounds(const std::vector<Vertex>& vertices) {
+	Bounds bounds{};
+	if (vertices.empty()) return bounds;
+
+	bounds.min = glm::vec3(vertices[0].vx, vertices[0].vy, vertices[0].vz);
+	bounds.max = bounds.min;
+	for (const Vertex& vertex : vertices) {
+		const glm::vec3 pos(vertex.vx, vertex.vy, vertex.vz);
+		bounds.min = glm::min(bounds.min, pos);
+		bounds.max = glm::max(bounds.max, pos);
+	}
+
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+	/* tighter than half the diagonal of the box */
+	float radiusSquared = 0.0f;
+	for (const Vertex& vertex : vertices) {
+		const glm::vec3 offset = glm::vec3(vertex.vx, vertex.vy, vertex.vz) - bounds.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	bounds.radius = std::sqrt(radiusSquared);
+
+	return bounds;
+}
+
+void IntermediateModelManager::buildLods(Mesh& mesh) {
+	PROFILE_SCOPE("IntermediateModelManager::buildLods");
+
+	mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+
+	std::vector<simplifier::level> levels = simplifier::buildLodChain(mesh.vertices, mesh.indices, MAX_MESH_LODS - 1);
+	for (const simplifier::level& level : levels) {
+		mesh.lods.push_back({ static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(level.indices.size()), level.error });
+		mesh.indices.insert(mesh.indices.end(), level.indices.begin(), level.indices.end());
+	}
+}
+
 void IntermediateModelManager::loadMesh(Object& target, const meshId_t& meshId, const tinyobj::attrib_t& attrib, const tinyobj::shape_t& shape) {
+	PROFILE_SCOPE("IntermediateModelManager::loadMesh");
+
 	Mesh mesh{};
 
 	std::unordered_map<tinyobj::index_t, uint16_t, HashIndex, CompareIndex> indexTracker;
@@ -83,11 +125,16 @@ void IntermediateModelManager::loadMesh(Object& target, const meshId_t& meshId,
 		}
 		index_offset += fv;
 	}
+
+	mesh.bounds = computeBounds(mesh.vertices);
+	buildLods(mesh);
 	
 	target.meshes.emplace(meshId, std::move(mesh));
 }
 
 void IntermediateModelManager::loadObject(const objectId_t& objectId) {
+	PROFILE_SCOPE("IntermediateModelManager::loadObject");
+
 	const std::filesystem::path objectPath = getPathFromId(objectId);
 	
 	tinyobj::ObjReaderConfig reader_config;
@@ -150,6 +197,8 @@ Material IntermediateModelManager::loadColorMaterial(const rapidjson::GenericObj
 }
 
 void IntermediateModelManager::loadMaterial(const materialId_t& materialId) {
+	PROFILE_SCOPE("IntermediateModelManager::loadMaterial");
+
 	rapidjson::Document document = parseJsonFile(materialId);
 	
 	// parse the data
@@ -189,12 +238,15 @@ const Material& IntermediateModelManager::getOrLoadMaterial(const materialId_t&
 /////////////////////////////////////////////////////////////////////////////////////////
 
 void IntermediateModelManager::loadShader(const shaderId_t& shaderId) {
+	PROFILE_SCOPE("IntermediateModelManager::loadShader");
+
 	rapidjson::Document document = parseJsonFile(shaderId);
 
 	// parse the data
 	assert(document.IsObject());
 
 	bool hasVertex = document.HasMember("vertex") && document["vertex"].IsString();
+	bool hasVertexInstanced = document.HasMember("vertexInstanced") && document["vertexInstanced"].IsString();
 	bool hasGeometry = document.HasMember("geometry") && document["geometry"].IsString();
 	bool hasFragment = document.HasMember("fragment") && document["fragment"].IsString();
 
@@ -203,6 +255,7 @@ void IntermediateModelManager::loadShader(const shaderId_t& shaderId) {
 	std::filesystem::path basePath = fileParamethers<shaderId_t>::directory;
 	
 	shader.vertex = (hasVertex) ? basePath / document["vertex"].GetString() : "";
+	shader.vertexInstanced = (hasVertexInstanced) ? basePath / document["vertexInstanced"].GetString() : "";
 	shader.geometry = (hasGeometry) ? basePath / document["geometry"].GetString() : "";
 	shader.fragment = (hasFragment) ? basePath / document["fragment"].GetString() : "";
 
@@ -309,7 +362,37 @@ void IntermediateModelManager::parseModelShader(Model& model, const rapidjson::D
 	throw std::runtime_error("Model has to have at least one material specified.");
 }
 
+void IntermediateModelManager::parseModelOccluders(Model& model, const rapidjson::Document& document, const Object& object) {
+	/* optional, true for every mesh or a list of them */
+	if (!document.HasMember("occluder")) return;
+
+	if (document["occluder"].IsBool()) {
+		if (!document["occluder"].GetBool()) return;
+
+		for (const auto& mesh : object.meshes) {
+			model.occluders.insert(mesh.first);
+		}
+
+		return;
+	}
+
+	if (document["occluder"].IsArray()) {
+		for (const auto& meshId : document["occluder"].GetArray()) {
+			assert(meshId.IsString());
+			assert(object.meshes.find(meshId_t(meshId.GetString())) != object.meshes.end());
+
+			model.occluders.insert(meshId_t(meshId.GetString()));
+		}
+
+		return;
+	}
+
+	throw std::runtime_error("The occluder of a model has to be a bool or an array of meshes.");
+}
+
 Model IntermediateModelManager::LoadModel(const modelId_t& modelId) {
+	PROFILE_SCOPE("IntermediateModelManager::LoadModel");
+
 	rapidjson::Document document = parseJsonFile(modelId);
 
 	assert(document.IsObject());
@@ -319,6 +402,7 @@ Model IntermediateModelManager::LoadModel(const modelId_t& modelId) {
 	const Object& object = parseModelObject(model, document);
 	parseModelMaterial(model, document, object);
 	parseModelShader(model, document, object);
+	parseModelOccluders(model, document, object);
 
 	return model;
 }
@@ -341,4 +425,8 @@ const Material& IntermediateModelManager::GetMaterial(const materialId_t& materi
 const Shader& IntermediateModelManager::GetShader(const shaderId_t& shaderId) {
 	assert(shaders.find(shaderId) != shaders.end());
 	return shaders.at(shaderId);
+}
+
+const Shader& IntermediateModelManager::LoadShader(const shaderId_t& shaderId) {
+	return getOrLoadShader(shaderId);
 }
\ No newline at end of file
@@ -35,11 +35,15 @@ private:
 	void ensureShaderLoaded(const shaderId_t& shaderId);
 	[[nodiscard]] const Shader& getOrLoadShader(const shaderId_t& shaderId);
 
+	static Bounds computeBounds(const std::vector<Vertex>& vertices);
+	/* appends the simplified levels to the indices */
+	static void buildLods(Mesh& mesh);
 	static void loadMesh(Object& target, const meshId_t& meshId, const tinyobj::attrib_t& attrib, const tinyobj::shape_t& shape);
 
 	const Object& parseModelObject(Model& model, const rapidjson::Document& document);
 	void parseModelMaterial(Model& model, const rapidjson::Document& document, const Object& object);
 	void parseModelShader(Model& model, const rapidjson::Document& document, const Object& object);
+	void parseModelOccluders(Model& model, const rapidjson::Document& document, const Object& object);
 
 public:
 	IntermediateModelManager();
@@ -50,4 +54,6 @@ public:
 	[[nodiscard]] const Object& GetObject(const objectId_t& objectId);
 	[[nodiscard]] const Material& GetMaterial(const materialId_t& materialId);
 	[[nodiscard]] const Shader& GetShader(const shaderId_t& shaderId);
+	/* for shaders no model uses */
+	const Shader& LoadShader(const shaderId_t& shaderId);
 };
\ No newline at end of file
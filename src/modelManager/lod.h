@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+
+/* the full mesh and up to 4 simplified levels */
+constexpr uint32_t MAX_MESH_LODS = 5;
+
+/* a level of detail of a mesh, a range of its indices */
+struct MeshLod {
+	/* relative to the first index of the mesh */
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	/* the simplification error, in the units of the mesh */
+	float error;
+};
\ No newline at end of file
@@ -5,10 +5,14 @@
 #include <filesystem>
 
 #include "../color.h"
+#include "bounds.h"
+#include "lod.h"
 #include "id_t.h"
 
 struct Shader {
 	std::filesystem::path vertex;
+	/* optional, used for instanced draws */
+	std::filesystem::path vertexInstanced;
 	std::filesystem::path geometry;
 	std::filesystem::path fragment;
 };
@@ -46,7 +50,11 @@ struct Vertex {
 
 struct Mesh {
 	std::vector<Vertex> vertices;
+	/* the indices of every level, one after another */
 	std::vector<uint16_t> indices;
+	/* the full mesh first */
+	std::vector<MeshLod> lods;
+	Bounds bounds;
 };
 
 struct Object {
@@ -57,4 +65,6 @@ struct Model {
 	objectId_t objectId;
 	id_umap<meshId_t, materialId_t> materialPerMesh;
 	id_umap<meshId_t, shaderId_t> shaderPerMesh;
+	/* the meshes drawn into the occlusion buffer */
+	id_uset<meshId_t> occluders;
 };
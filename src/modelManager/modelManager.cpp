@@ -1,5 +1,7 @@
 #include "modelManager.h"
 
+#include "../profiler.h"
+
 
 ModelManager::ModelManager(std::shared_ptr<entt::registry> registry) {
 	intermediateMngr = std::make_unique<IntermediateModelManager>();
@@ -10,11 +12,29 @@ ModelManager::~ModelManager() {}
 
 
 void ModelManager::LoadModel(const modelId_t& modelId) {
+	PROFILE_SCOPE("ModelManager::LoadModel");
+
 	models.emplace(modelId, intermediateMngr->LoadModel(modelId));
 	glMngr->PrepareModel(models.at(modelId));
 }
 
+void ModelManager::UnloadModel(const modelId_t& modelId) {
+	PROFILE_SCOPE("ModelManager::UnloadModel");
+
+	auto it = models.find(modelId);
+	if (it == models.end()) return;
+
+	glMngr->UnloadModel(it->second);
+	models.erase(it);
+}
+
+void ModelManager::CompactGeometry() {
+	glMngr->CompactGeometry();
+}
+
 void ModelManager::CreateInstance(entt::entity parent, const modelId_t& modelId) {
+	PROFILE_SCOPE("ModelManager::CreateInstance");
+
 	if (models.find(modelId) == models.end()) {
 		std::stringstream ss;
 		ss << "Model " << modelId.str << " is not loaded.";
@@ -24,6 +44,21 @@ void ModelManager::CreateInstance(entt::entity parent, const modelId_t& modelId)
 	glMngr->CreateInstance(parent, models.at(modelId));
 }
 
+void ModelManager::DestroyInstance(entt::entity parent) {
+	PROFILE_SCOPE("ModelManager::DestroyInstance");
+
+	glMngr->DestroyInstance(parent);
+}
+
 const id_umap<shaderId_t, comps::shader>& ModelManager::GetShaders() const {
 	return glMngr->GetShaders();
 }
+
+const comps::shader& ModelManager::GetShader(const shaderId_t& shaderId) {
+	intermediateMngr->LoadShader(shaderId);
+	return glMngr->GetShader(shaderId);
+}
+
+GLuint ModelManager::GetPositionVao() const {
+	return glMngr->GetPositionVao();
+}
@@ -15,7 +15,15 @@ public:
 	~ModelManager();
 
 	void LoadModel(const modelId_t& modelId);
+	/* its instances have to be destroyed before */
+	void UnloadModel(const modelId_t& modelId);
+	void CompactGeometry();
 	void CreateInstance(entt::entity parent, const modelId_t& modelId);
+	void DestroyInstance(entt::entity parent);
 
 	const id_umap<shaderId_t, comps::shader>& GetShaders() const;
+	/* loads and links the shader if no model did yet */
+	const comps::shader& GetShader(const shaderId_t& shaderId);
+	/* the VAO of every mesh reading only the positions */
+	GLuint GetPositionVao() const;
 };
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "simplifier.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <queue>
+#include <tuple>
+
+#include <glm/glm.hpp>
+
+
+/* a level has to drop at least this part of the triangles of the previous one */
+constexpr float MIN_LEVEL_REDUCTION = 0.1f;
+/* collapses turning a triangle further than this (the cosine) are rejected */
+constexpr float MAX_FLIP_COSINE = 0.2f;
+
+/* the symmetric 4x4 matrix of the summed squared distances to planes */
+struct quadric {
+	double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+	void addPlane(const glm::dvec3& n, double d) {
+		xx += n.x * n.x; xy += n.x * n.y; xz += n.x * n.z; xw += n.x * d;
+		yy += n.y * n.y; yz += n.y * n.z; yw += n.y * d;
+		zz += n.z * n.z; zw += n.z * d;
+		ww += d * d;
+	}
+
+	quadric operator+(const quadric& o) const {
+		quadric q;
+		q.xx = xx + o.xx; q.xy = xy + o.xy; q.xz = xz + o.xz; q.xw = xw + o.xw;
+		q.yy = yy + o.yy; q.yz = yz + o.yz; q.yw = yw + o.yw;
+		q.zz = zz + o.zz; q.zw = zw + o.zw;
+		q.ww = ww + o.ww;
+		return q;
+	}
+
+	double evaluate(const glm::vec3& p) const {
+		const double x = p.x, y = p.y, z = p.z;
+		return xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x
+			+ yy * y * y + 2 * yz * y * z + 2 * yw * y
+			+ zz * z * z + 2 * zw * z
+			+ ww;
+	}
+};
+
+/* moving `from` onto `to`, valid while neither vertex changed since it was queued */
+struct collapse {
+	double cost;
+	uint32_t from;
+	uint32_t to;
+	uint32_t fromVersion;
+	uint32_t toVersion;
+
+	bool operator>(const collapse& other) const { return cost > other.cost; }
+};
+
+struct simplifyState {
+	const std::vector<Vertex>* vertices = nullptr;
+	/* the first vertex with the same position, the collapses run on these welded vertices */
+	std::vector<uint32_t> welded;
+	/* the vertices sharing the position of a welded vertex, split by normals or texture coordinates */
+	std::vector<std::vector<uint32_t>> wedges;
+
+	std::vector<glm::vec3> positions;
+	std::vector<quadric> quadrics;
+	std::vector<bool> locked;
+	std::vector<bool> removed;
+	std::vector<uint32_t> versions;
+
+	/* of welded vertices */
+	std::vector<std::array<uint32_t, 3>> triangles;
+	/* the vertices the triangles are drawn with */
+	std::vector<std::array<uint32_t, 3>> corners;
+	std::vector<bool> alive;
+	uint32_t aliveCount = 0;
+	/* may still list dead triangles and triangles the vertex left */
+	std::vector<std::vector<uint32_t>> vertexTriangles;
+
+	std::priority_queue<collapse, std::vector<collapse>, std::greater<collapse>> queue;
+	double maxCost = 0;
+};
+
+static bool contains(const std::array<uint32_t, 3>& triangle, uint32_t vertex) {
+	return triangle[0] == vertex || triangle[1] == vertex || triangle[2] == vertex;
+}
+
+static glm::vec3 triangleNormal(const simplifyState& state, const std::array<uint32_t, 3>& triangle) {
+	const glm::vec3& a = state.positions[triangle[0]];
+	return glm::cross(state.positions[triangle[1]] - a, state.positions[triangle[2]] - a);
+}
+
+static void queueEdge(simplifyState& state, uint32_t a, uint32_t b) {
+	if (state.locked[a] && state.locked[b]) return;
+
+	const quadric q = state.quadrics[a] + state.quadrics[b];
+	const double infinity = std::numeric_limits<double>::infinity();
+	const double costAB = state.locked[a] ? infinity : q.evaluate(state.positions[b]);
+	const double costBA = state.locked[b] ? infinity : q.evaluate(state.positions[a]);
+
+	if (costAB <= costBA) state.queue.push({ costAB, a, b, state.versions[a], state.versions[b] });
+	else state.queue.push({ costBA, b, a, state.versions[b], state.versions[a] });
+}
+
+static void queueEdgesOf(simplifyState& state, uint32_t vertex) {
+	for (uint32_t t : state.vertexTriangles[vertex]) {
+		if (!state.alive[t] || !contains(state.triangles[t], vertex)) continue;
+
+		for (uint32_t other : state.triangles[t]) {
+			if (other != vertex) queueEdge(state, vertex, other);
+		}
+	}
+}
+
+static bool flipsTriangles(const simplifyState& state, uint32_t from, uint32_t to) {
+	for (uint32_t t : state.vertexTriangles[from]) {
+		const std::array<uint32_t, 3>& triangle = state.triangles[t];
+		if (!state.alive[t] || !contains(triangle, from) || contains(triangle, to)) continue;
+
+		std::array<uint32_t, 3> moved = triangle;
+		for (uint32_t& vertex : moved) {
+			if (vertex == from) vertex = to;
+		}
+
+		const glm::vec3 before = triangleNormal(state, triangle);
+		const glm::vec3 after = triangleNormal(state, moved);
+		const float lengths = glm::length(before) * glm::length(after);
+
+		if (lengths <= 0.0f || glm::dot(before, after) < MAX_FLIP_COSINE * lengths) return true;
+	}
+	return false;
+}
+
+static bool sameTexCoord(const Vertex& a, const Vertex& b) {
+	return a.tx == b.tx && a.ty == b.ty;
+}
+
+/* the vertex of `to` a corner moving there is drawn with, on the side of its seams the collapsed triangles are on */
+static uint32_t pickWedge(const simplifyState& state, uint32_t to, uint32_t side, uint32_t corner) {
+	const std::vector<Vertex>& vertices = *state.vertices;
+	const glm::vec3 normal(vertices[corner].nx, vertices[corner].ny, vertices[corner].nz);
+
+	uint32_t best = side;
+	float bestDot = -std::numeric_limits<float>::infinity();
+	for (uint32_t wedge : state.wedges[to]) {
+		if (!sameTexCoord(vertices[wedge], vertices[side])) continue;
+
+		const float dot = glm::dot(normal, glm::vec3(vertices[wedge].nx, vertices[wedge].ny, vertices[wedge].nz));
+		if (dot > bestDot) {
+			bestDot = dot;
+			best = wedge;
+		}
+	}
+	return best;
+}
+
+static void applyCollapse(simplifyState& state, const collapse& c) {
+	/* `from` isn't on a seam, so all its triangles are on the side of the ones the collapse removes */
+	uint32_t side = state.wedges[c.to].front();
+	for (uint32_t t : state.vertexTriangles[c.from]) {
+		const std::array<uint32_t, 3>& triangle = state.triangles[t];
+		if (!state.alive[t] || !contains(triangle, c.from) || !contains(triangle, c.to)) continue;
+
+		for (int k = 0; k < 3; k++) {
+			if (triangle[k] == c.to) side = state.corners[t][k];
+		}
+		break;
+	}
+
+	for (uint32_t t : state.vertexTriangles[c.from]) {
+		std::array<uint32_t, 3>& triangle = state.triangles[t];
+		if (!state.alive[t] || !contains(triangle, c.from)) continue;
+
+		if (contains(triangle, c.to)) {
+			state.alive[t] = false;
+			state.aliveCount--;
+			continue;
+		}
+
+		for (int k = 0; k < 3; k++) {
+			if (triangle[k] != c.from) continue;
+
+			triangle[k] = c.to;
+			state.corners[t][k] = pickWedge(state, c.to, side, state.corners[t][k]);
+		}
+		state.vertexTriangles[c.to].push_back(t);
+	}
+
+	state.quadrics[c.to] = state.quadrics[c.to] + state.quadrics[c.from];
+	state.removed[c.from] = true;
+	state.versions[c.to]++;
+	state.maxCost = std::max(state.maxCost, c.cost);
+
+	queueEdgesOf(state, c.to);
+}
+
+static void initState(simplifyState& state, const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices) {
+	const size_t vertexCount = vertices.size();
+
+	state.positions.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		state.positions[v] = glm::vec3(vertices[v].vx, vertices[v].vy, vertices[v].vz);
+	}
+	state.quadrics.resize(vertexCount);
+	state.locked.assign(vertexCount, false);
+	state.removed.assign(vertexCount, false);
+	state.versions.assign(vertexCount, 0);
+	state.vertexTriangles.resize(vertexCount);
+	state.vertices = &vertices;
+
+	/* flat shading and hard edges split every vertex by its normal, welding keeps the surface connected */
+	state.welded.resize(vertexCount);
+	state.wedges.resize(vertexCount);
+	std::map<std::tuple<float, float, float>, uint32_t> firstWithPosition;
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		const glm::vec3& p = state.positions[v];
+		const uint32_t welded = firstWithPosition.try_emplace({ p.x, p.y, p.z }, v).first->second;
+
+		state.welded[v] = welded;
+		state.wedges[welded].push_back(v);
+	}
+
+	/* seams, the texture coordinates jump, moving such a vertex would tear the texture */
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		const std::vector<uint32_t>& wedges = state.wedges[v];
+		for (uint32_t wedge : wedges) {
+			if (!sameTexCoord(vertices[wedge], vertices[wedges.front()])) state.locked[v] = true;
+		}
+	}
+
+	/* borders, edges of a single triangle */
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> edgeUses;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		const std::array<uint32_t, 3> corners = { indices[i], indices[i + 1], indices[i + 2] };
+		const std::array<uint32_t, 3> triangle = { state.welded[corners[0]], state.welded[corners[1]], state.welded[corners[2]] };
+		if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0]) continue;
+
+		const uint32_t t = static_cast<uint32_t>(state.triangles.size());
+		state.triangles.push_back(triangle);
+		state.corners.push_back(corners);
+		state.alive.push_back(true);
+		state.aliveCount++;
+
+		for (int corner = 0; corner < 3; corner++) {
+			const uint32_t a = triangle[corner], b = triangle[(corner + 1) % 3];
+			edgeUses[{ std::min(a, b), std::max(a, b) }]++;
+			state.vertexTriangles[a].push_back(t);
+		}
+
+		const glm::vec3 normal = triangleNormal(state, triangle);
+		const float length = glm::length(normal);
+		if (length > 0.0f) {
+			const glm::dvec3 n = glm::dvec3(normal / length);
+			const double d = -glm::dot(n, glm::dvec3(state.positions[triangle[0]]));
+			for (uint32_t vertex : triangle) state.quadrics[vertex].addPlane(n, d);
+		}
+	}
+	for (const auto& [edge, uses] : edgeUses) {
+		if (uses == 1) {
+			state.locked[edge.first] = true;
+			state.locked[edge.second] = true;
+		}
+	}
+
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		queueEdgesOf(state, v);
+	}
+}
+
+std::vector<simplifier::level> simplifier::buildLodChain(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices, uint32_t levelCount) {
+	simplifyState state;
+	initState(state, vertices, indices);
+
+	std::vector<level> levels;
+	const uint32_t fullCount = state.aliveCount;
+	uint32_t previousCount = fullCount;
+
+	for (uint32_t l = 1; l <= levelCount; l++) {
+		const uint32_t target = fullCount >> l;
+
+		while (state.aliveCount > target && !state.queue.empty()) {
+			const collapse c = state.queue.top();
+			state.queue.pop();
+
+			if (state.removed[c.from] || state.removed[c.to]) continue;
+			if (state.versions[c.from] != c.fromVersion || state.versions[c.to] != c.toVersion) continue;
+			if (flipsTriangles(state, c.from, c.to)) continue;
+
+			applyCollapse(state, c);
+		}
+
+		if (state.aliveCount > previousCount * (1.0f - MIN_LEVEL_REDUCTION)) break;
+		previousCount = state.aliveCount;
+
+		level result;
+		result.error = static_cast<float>(std::sqrt(state.maxCost));
+		result.indices.reserve(state.aliveCount * 3);
+		for (size_t t = 0; t < state.triangles.size(); t++) {
+			if (!state.alive[t]) continue;
+			for (uint32_t vertex : state.corners[t]) result.indices.push_back(static_cast<uint16_t>(vertex));
+		}
+		levels.push_back(std::move(result));
+	}
+
+	return levels;
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+/*
+	Quadric error metric mesh simplification (Garland & Heckbert).
+
+	Edges are collapsed onto one of their vertices, cheapest first, so every level only
+	has new indices and all of them share the vertices of the full mesh. The collapses
+	run on vertices welded by position, so normals split by hard edges don't stop them,
+	a moved corner takes the vertex of its target with the closest normal. Vertices on
+	borders and on texture seams (the same position with other texture coordinates)
+	never move, which keeps the levels free of cracks.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "model.h"
+
+
+namespace simplifier {
+	struct level {
+		std::vector<uint16_t> indices;
+		/* the largest distance from the surface of a collapse, in the units of the mesh */
+		float error;
+	};
+
+	/* each level has about half the triangles of the previous one, the chain ends early
+	   when the mesh can't be reduced any more, the full mesh is not part of it */
+	std::vector<level> buildLodChain(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices, uint32_t levelCount);
+}
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "affine.h"
+#include "profiler.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OCCLUSION_SSE 1
+#include <immintrin.h>
+#else
+#define OCCLUSION_SSE 0
+#endif
+
+
+OcclusionBuffer::OcclusionBuffer()
+	: viewProjection(1.0f)
+	, depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 0.0f)
+	, tileDepth{}
+{}
+
+void OcclusionBuffer::BeginFrame(const glm::mat4& viewProjection) {
+	this->viewProjection = viewProjection;
+
+	triangles.clear();
+	for (std::vector<uint32_t>& bin : bins) bin.clear();
+}
+
+static glm::vec3 toScreen(const glm::vec4& clip) {
+	const float invW = 1.0f / clip.w;
+	return glm::vec3(
+		(clip.x * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+		(clip.y * invW * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+		invW
+	);
+}
+
+void OcclusionBuffer::binTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+	/* clipping at the near plane could only add occlusion, skipping is safe */
+	if (a.w < OCCLUSION_MIN_W || b.w < OCCLUSION_MIN_W || c.w < OCCLUSION_MIN_W) return;
+
+	const screenTriangle triangle = { { toScreen(a), toScreen(b), toScreen(c) } };
+	const glm::vec3* v = triangle.v;
+
+	/* counter clockwise on screen faces the camera */
+	const float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (!(area > 0.0f)) return;
+
+	const float minX = std::max(std::floor(std::min({ v[0].x, v[1].x, v[2].x })), 0.0f);
+	const float maxX = std::min(std::ceil(std::max({ v[0].x, v[1].x, v[2].x })), static_cast<float>(OCCLUSION_WIDTH));
+	const float minY = std::max(std::floor(std::min({ v[0].y, v[1].y, v[2].y })), 0.0f);
+	const float maxY = std::min(std::ceil(std::max({ v[0].y, v[1].y, v[2].y })), static_cast<float>(OCCLUSION_HEIGHT));
+	if (minX >= maxX || minY >= maxY) return;
+
+	const uint32_t tileX0 = static_cast<uint32_t>(minX) / OCCLUSION_TILE_WIDTH;
+	const uint32_t tileX1 = (static_cast<uint32_t>(maxX) - 1) / OCCLUSION_TILE_WIDTH;
+	const uint32_t tileY0 = static_cast<uint32_t>(minY) / OCCLUSION_TILE_HEIGHT;
+	const uint32_t tileY1 = (static_cast<uint32_t>(maxY) - 1) / OCCLUSION_TILE_HEIGHT;
+
+	const uint32_t index = static_cast<uint32_t>(triangles.size());
+	triangles.push_back(triangle);
+
+	for (uint32_t ty = tileY0; ty <= tileY1; ty++) {
+		for (uint32_t tx = tileX0; tx <= tileX1; tx++) {
+			bins[ty * OCCLUSION_TILES_X + tx].push_back(index);
+		}
+	}
+}
+
+void OcclusionBuffer::AddOccluder(const occluderMesh& mesh, const glm::mat4x3& model) {
+	const glm::mat4 transform = viewProjection * affine::toMat4(model);
+
+	clipScratch.resize(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); i++) {
+		clipScratch[i] = transform * glm::vec4(mesh.positions[i], 1.0f);
+	}
+
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		binTriangle(clipScratch[mesh.indices[i]], clipScratch[mesh.indices[i + 1]], clipScratch[mesh.indices[i + 2]]);
+	}
+}
+
+/* an edge function or the depth, value = x * dx + y * dy + c at pixel centers */
+struct screenPlane {
+	double dx, dy, c;
+
+	double at(double x, double y) const { return x * dx + y * dy + c; }
+};
+
+/* positive on the inner side of the edge from a to b */
+static screenPlane edgePlane(const glm::vec3& a, const glm::vec3& b) {
+	const double dx = -(static_cast<double>(b.y) - a.y);
+	const double dy = static_cast<double>(b.x) - a.x;
+	return { dx, dy, -(dx * a.x + dy * a.y) };
+}
+
+static screenPlane depthPlane(const glm::vec3* v) {
+	const double x1 = static_cast<double>(v[1].x) - v[0].x, y1 = static_cast<double>(v[1].y) - v[0].y, z1 = static_cast<double>(v[1].z) - v[0].z;
+	const double x2 = static_cast<double>(v[2].x) - v[0].x, y2 = static_cast<double>(v[2].y) - v[0].y, z2 = static_cast<double>(v[2].z) - v[0].z;
+	const double area = x1 * y2 - x2 * y1;
+
+	const double dx = (z1 * y2 - z2 * y1) / area;
+	const double dy = (z2 * x1 - z1 * x2) / area;
+	return { dx, dy, v[0].z - dx * v[0].x - dy * v[0].y };
+}
+
+void OcclusionBuffer::rasterizeTile(uint32_t tile) {
+	const uint32_t tileX = (tile % OCCLUSION_TILES_X) * OCCLUSION_TILE_WIDTH;
+	const uint32_t tileY = (tile / OCCLUSION_TILES_X) * OCCLUSION_TILE_HEIGHT;
+
+	for (uint32_t y = tileY; y < tileY + OCCLUSION_TILE_HEIGHT; y++) {
+		std::fill_n(depth.begin() + y * OCCLUSION_WIDTH + tileX, OCCLUSION_TILE_WIDTH, 0.0f);
+	}
+
+	for (uint32_t index : bins[tile]) {
+		const glm::vec3* v = triangles[index].v;
+		const screenPlane edges[3] = { edgePlane(v[0], v[1]), edgePlane(v[1], v[2]), edgePlane(v[2], v[0]) };
+		const screenPlane z = depthPlane(v);
+
+		/* the start is a multiple of 4 pixels from the tile start, so the steps never leave the tile */
+		const uint32_t minX = std::max(static_cast<uint32_t>(std::max(std::min({ v[0].x, v[1].x, v[2].x }), 0.0f)), tileX) & ~3u;
+		const uint32_t maxX = std::min(static_cast<uint32_t>(std::ceil(std::max({ v[0].x, v[1].x, v[2].x }))), tileX + OCCLUSION_TILE_WIDTH);
+		const uint32_t minY = std::max(static_cast<uint32_t>(std::max(std::min({ v[0].y, v[1].y, v[2].y }), 0.0f)), tileY);
+		const uint32_t maxY = std::min(static_cast<uint32_t>(std::ceil(std::max({ v[0].y, v[1].y, v[2].y }))), tileY + OCCLUSION_TILE_HEIGHT);
+
+		for (uint32_t y = minY; y < maxY; y++) {
+			float* row = depth.data() + y * OCCLUSION_WIDTH;
+			const double centerX = minX + 0.5, centerY = y + 0.5;
+
+			/* the row start in doubles keeps the precision for triangles far outside the screen */
+			const float e0 = static_cast<float>(edges[0].at(centerX, centerY));
+			const float e1 = static_cast<float>(edges[1].at(centerX, centerY));
+			const float e2 = static_cast<float>(edges[2].at(centerX, centerY));
+			const float z0 = static_cast<float>(z.at(centerX, centerY));
+
+#if OCCLUSION_SSE
+			const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+			__m128 edge0 = _mm_add_ps(_mm_set1_ps(e0), _mm_mul_ps(lane, _mm_set1_ps(static_cast<float>(edges[0].dx))));
+			__m128 edge1 = _mm_add_ps(_mm_set1_ps(e1), _mm_mul_ps(lane, _mm_set1_ps(static_cast<float>(edges[1].dx))));
+			__m128 edge2 = _mm_add_ps(_mm_set1_ps(e2), _mm_mul_ps(lane, _mm_set1_ps(static_cast<float>(edges[2].dx))));
+			__m128 pixelZ = _mm_add_ps(_mm_set1_ps(z0), _mm_mul_ps(lane, _mm_set1_ps(static_cast<float>(z.dx))));
+
+			const __m128 step0 = _mm_set1_ps(static_cast<float>(edges[0].dx * 4.0));
+			const __m128 step1 = _mm_set1_ps(static_cast<float>(edges[1].dx * 4.0));
+			const __m128 step2 = _mm_set1_ps(static_cast<float>(edges[2].dx * 4.0));
+			const __m128 stepZ = _mm_set1_ps(static_cast<float>(z.dx * 4.0));
+			const __m128 zero = _mm_setzero_ps();
+
+			for (uint32_t x = minX; x < maxX; x += 4) {
+				const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(edge0, zero), _mm_cmpgt_ps(edge1, zero)), _mm_cmpgt_ps(edge2, zero));
+
+				if (_mm_movemask_ps(inside) != 0) {
+					const __m128 old = _mm_loadu_ps(row + x);
+					const __m128 nearer = _mm_max_ps(old, pixelZ);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+				}
+
+				edge0 = _mm_add_ps(edge0, step0);
+				edge1 = _mm_add_ps(edge1, step1);
+				edge2 = _mm_add_ps(edge2, step2);
+				pixelZ = _mm_add_ps(pixelZ, stepZ);
+			}
+#else
+			for (uint32_t x = minX; x < maxX; x++) {
+				const float offset = static_cast<float>(x - minX);
+				if (e0 + offset * static_cast<float>(edges[0].dx) > 0.0f
+					&& e1 + offset * static_cast<float>(edges[1].dx) > 0.0f
+					&& e2 + offset * static_cast<float>(edges[2].dx) > 0.0f) {
+					row[x] = std::max(row[x], z0 + offset * static_cast<float>(z.dx));
+				}
+			}
+#endif
+		}
+	}
+
+	float farthest = std::numeric_limits<float>::max();
+	for (uint32_t y = tileY; y < tileY + OCCLUSION_TILE_HEIGHT; y++) {
+		const float* row = depth.data() + y * OCCLUSION_WIDTH + tileX;
+		farthest = std::min(farthest, *std::min_element(row, row + OCCLUSION_TILE_WIDTH));
+	}
+	tileDepth[tile] = farthest;
+}
+
+void OcclusionBuffer::Rasterize(const std::shared_ptr<ThreadPool>& threadPool) {
+	PROFILE_SCOPE("OcclusionBuffer::Rasterize");
+
+	threadPool->ParallelFor(bins.size(), 1, [this](size_t begin, size_t end) {
+		PROFILE_SCOPE("OcclusionBuffer::rasterizeTile");
+
+		for (size_t tile = begin; tile < end; tile++) {
+			rasterizeTile(static_cast<uint32_t>(tile));
+		}
+	});
+}
+
+bool OcclusionBuffer::TestBox(const aabb& box) const {
+	float minX = static_cast<float>(OCCLUSION_WIDTH), maxX = 0.0f;
+	float minY = static_cast<float>(OCCLUSION_HEIGHT), maxY = 0.0f;
+	float nearest = 0.0f;
+
+	for (int corner = 0; corner < 8; corner++) {
+		const glm::vec3 p(
+			(corner & 1) ? box.max.x : box.min.x,
+			(corner & 2) ? box.max.y : box.min.y,
+			(corner & 4) ? box.max.z : box.min.z
+		);
+		const glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+
+		/* the box reaches the camera */
+		if (clip.w < OCCLUSION_MIN_W) return true;
+
+		const glm::vec3 screen = toScreen(clip);
+		minX = std::min(minX, screen.x); maxX = std::max(maxX, screen.x);
+		minY = std::min(minY, screen.y); maxY = std::max(maxY, screen.y);
+		nearest = std::max(nearest, screen.z);
+	}
+
+	const uint32_t x0 = static_cast<uint32_t>(std::max(std::floor(minX), 0.0f));
+	const uint32_t x1 = static_cast<uint32_t>(std::min(std::ceil(maxX), static_cast<float>(OCCLUSION_WIDTH)));
+	const uint32_t y0 = static_cast<uint32_t>(std::max(std::floor(minY), 0.0f));
+	const uint32_t y1 = static_cast<uint32_t>(std::min(std::ceil(maxY), static_cast<float>(OCCLUSION_HEIGHT)));
+	/* off screen, it's up to frustum culling */
+	if (x0 >= x1 || y0 >= y1) return true;
+
+	for (uint32_t ty = y0 / OCCLUSION_TILE_HEIGHT; ty <= (y1 - 1) / OCCLUSION_TILE_HEIGHT; ty++) {
+		for (uint32_t tx = x0 / OCCLUSION_TILE_WIDTH; tx <= (x1 - 1) / OCCLUSION_TILE_WIDTH; tx++) {
+			if (nearest < tileDepth[ty * OCCLUSION_TILES_X + tx]) continue;
+
+			const uint32_t px0 = std::max(x0, tx * OCCLUSION_TILE_WIDTH), px1 = std::min(x1, (tx + 1) * OCCLUSION_TILE_WIDTH);
+			const uint32_t py0 = std::max(y0, ty * OCCLUSION_TILE_HEIGHT), py1 = std::min(y1, (ty + 1) * OCCLUSION_TILE_HEIGHT);
+
+			for (uint32_t y = py0; y < py1; y++) {
+				const float* row = depth.data() + y * OCCLUSION_WIDTH;
+				for (uint32_t x = px0; x < px1; x++) {
+					if (row[x] <= nearest) return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+uint32_t OcclusionBuffer::GetTriangleCount() const {
+	return static_cast<uint32_t>(triangles.size());
+}
+
+const float* OcclusionBuffer::GetDepth() const {
+	return depth.data();
+}
\ No newline at end of file
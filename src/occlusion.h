@@ -0,0 +1,82 @@
+/*
+	Software occlusion culling.
+
+	Occluders, simplified meshes of large opaque objects, are rasterized on the CPU into
+	a small depth buffer of 1 / w, which is linear on screen, so the depth of a pixel is
+	a plane equation of the triangle. The screen is split into tiles: triangles are
+	binned into the tiles they touch and every tile is rasterized by one job, 4 pixels
+	at a time with SSE. Each tile keeps the farthest depth of its pixels, a level above
+	the pixels that decides most box tests without looking at them.
+
+	Boxes are tested with the depth of their nearest corner over the screen rectangle
+	of their corners, so a box is only reported hidden when all of it is. Nothing here
+	needs a GL context.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "aabbTree.h"
+#include "threadPool.h"
+
+
+constexpr uint32_t OCCLUSION_WIDTH = 256;
+constexpr uint32_t OCCLUSION_HEIGHT = 128;
+/* the width is a multiple of the 4 pixels rasterized at once */
+constexpr uint32_t OCCLUSION_TILE_WIDTH = 32;
+constexpr uint32_t OCCLUSION_TILE_HEIGHT = 16;
+constexpr uint32_t OCCLUSION_TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH;
+constexpr uint32_t OCCLUSION_TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT;
+/* triangles with a vertex this close to the camera plane or behind it are skipped */
+constexpr float OCCLUSION_MIN_W = 1e-3f;
+
+/* the positions and the indices of a mesh drawn into the occlusion buffer */
+struct occluderMesh {
+	std::vector<glm::vec3> positions;
+	std::vector<uint16_t> indices;
+};
+
+class OcclusionBuffer {
+private:
+	/* in pixels, z is 1 / w */
+	struct screenTriangle {
+		glm::vec3 v[3];
+	};
+
+	glm::mat4 viewProjection;
+
+	std::vector<screenTriangle> triangles;
+	std::array<std::vector<uint32_t>, OCCLUSION_TILES_X * OCCLUSION_TILES_Y> bins;
+	std::vector<glm::vec4> clipScratch;
+
+	/* rows of pixels, 0 where nothing was drawn */
+	std::vector<float> depth;
+	/* the farthest pixel of each tile */
+	std::array<float, OCCLUSION_TILES_X * OCCLUSION_TILES_Y> tileDepth;
+
+	void binTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+	void rasterizeTile(uint32_t tile);
+
+public:
+	OcclusionBuffer();
+
+	/* drops the occluders of the last frame */
+	void BeginFrame(const glm::mat4& viewProjection);
+	/* transforms the triangles by model and bins the ones facing the camera */
+	void AddOccluder(const occluderMesh& mesh, const glm::mat4x3& model);
+	/* draws the binned triangles, a job per tile */
+	void Rasterize(const std::shared_ptr<ThreadPool>& threadPool);
+
+	/* false if the world space box is behind the occluders, safe to call from many threads */
+	bool TestBox(const aabb& box) const;
+
+	uint32_t GetTriangleCount() const;
+	/* the row major pixels, bottom row first */
+	const float* GetDepth() const;
+};
\ No newline at end of file
@@ -6,41 +6,14 @@
 #include <algorithm>
 
 #include "programManager.h"
+#include "glDebug.h"
 #include "constants.h"
+#include "textureFile.h"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
 
-void saveColorTextureToFile(GLuint textureID, int width, int height, const std::string& filename) {
-	// Create a buffer to hold the texture data
-	unsigned char* buffer = new unsigned char[width * height * 4]; // assuming 4 bytes for RGBA
-
-	// Bind the texture and read its data into the buffer
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
-
-	// Create an SDL_Surface from the buffer
-	SDL_Surface* surface = SDL_CreateRGBSurfaceFrom(
-		buffer,
-		width,
-		height,
-		32, // 32 bits depth
-		width * 4, // pitch
-		0x000000FF, // R mask
-		0x0000FF00, // G mask
-		0x00FF0000, // B mask
-		0xFF000000  // A mask
-	);
-
-	// Save the surface to a PNG file using SDL2_image
-	IMG_SavePNG(surface, filename.c_str());
-
-	// Cleanup
-	SDL_FreeSurface(surface);
-	delete[] buffer;
-}
-
 void saveDepthTextureToFile(GLuint textureID, int width, int height, const std::string& filename) {
 	// Create a buffer to hold the texture data
 	float* buffer = new float[width * height]; // assuming 4 bytes for RGBA
@@ -226,13 +199,7 @@ void PostprocessManager::Resize(int width, int height) {
 }
 
 void PostprocessManager::BeforeRender(const Color::RGB& bgColor) {
-	GLenum err;
-	while ((err = glGetError()) != GL_NO_ERROR);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "OpenGL error (during binding framebuffer): " << err << std::endl;
-	}
+	GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fbo));
 
 	glEnable(GL_DEPTH_TEST);
 
@@ -247,17 +214,10 @@ void PostprocessManager::BeforeRender(const Color::RGB& bgColor) {
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-	glDrawBuffers(2, drawBuffers);
-
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "OpenGL error (during setting framebuffer textures): " << err << std::endl;
-	}
+	GL_CHECK(glDrawBuffers(2, drawBuffers));
 }
 
 void PostprocessManager::AfterRender(const Color::RGB& bgColor, const std::unique_ptr<Camera>& camera) {
-	GLenum err;
-	while ((err = glGetError()) != GL_NO_ERROR);
-
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	// Render using postprocessing
@@ -267,10 +227,7 @@ void PostprocessManager::AfterRender(const Color::RGB& bgColor, const std::uniqu
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	glUseProgram(shaderProgram);
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "OpenGL error (during binding postprocess shader): " << err << std::endl;
-	}
+	GL_CHECK(glUseProgram(shaderProgram));
 
 	glUniform3f(bgColorLoc, bgColor.r, bgColor.g, bgColor.b);
 
@@ -284,20 +241,11 @@ void PostprocessManager::AfterRender(const Color::RGB& bgColor, const std::uniqu
 	glBindTexture(GL_TEXTURE_2D, normalTexture);
 
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, depthTexture);
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "OpenGL error (during binding postprocess textures): " << err << std::endl;
-	}
+	GL_CHECK(glBindTexture(GL_TEXTURE_2D, depthTexture));
 
-	glBindVertexArray(vao);
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "OpenGL error (during binding postprocess VAO): " << err << std::endl;
-	}
+	GL_CHECK(glBindVertexArray(vao));
 
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		std::cerr << "OpenGL error (during postprocess render): " << err << std::endl;
-	}
+	GL_CHECK(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0));
 
 	glBindVertexArray(0);
 	glUseProgram(0);
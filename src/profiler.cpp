@@ -0,0 +1,177 @@
+#include "profiler.h"
+
+#if PROFILING_ENABLED
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+/* zones kept per thread, a power of two */
+constexpr uint64_t PROFILER_BUFFER_SIZE = 1 << 16;
+
+/* nothing of the profiler's state is visible outside this file */
+namespace {
+
+struct profilerEvent {
+	const char* name;
+	uint64_t start;
+	uint64_t end;
+};
+
+/* written only by its own thread, read when a capture is written */
+struct profilerBuffer {
+	uint32_t threadId;
+	std::string threadName;
+	std::vector<profilerEvent> events;
+	std::atomic<uint64_t> written{ 0 };
+};
+
+struct profilerCapture {
+	bool active = false;
+	uint32_t frames = 0;
+	uint32_t framesLeft = 0;
+	uint64_t start = 0;
+	std::string path;
+};
+
+std::mutex profilerBuffersMtx;
+std::vector<std::unique_ptr<profilerBuffer>> profilerBuffers;
+thread_local profilerBuffer* localProfilerBuffer = nullptr;
+
+profilerCapture capture;
+
+uint64_t profilerNow() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+profilerBuffer& getLocalProfilerBuffer() {
+	if (!localProfilerBuffer) {
+		std::lock_guard<std::mutex> lock(profilerBuffersMtx);
+
+		auto buffer = std::make_unique<profilerBuffer>();
+		buffer->threadId = static_cast<uint32_t>(profilerBuffers.size());
+		buffer->threadName = "thread " + std::to_string(buffer->threadId);
+		buffer->events.resize(PROFILER_BUFFER_SIZE);
+
+		localProfilerBuffer = buffer.get();
+		profilerBuffers.push_back(std::move(buffer));
+	}
+	return *localProfilerBuffer;
+}
+
+/* a JSON string, quotes, backslashes and control characters escaped */
+void writeJsonString(std::ostream& out, const char* text) {
+	out << '"';
+	for (const char* c = text; *c; c++) {
+		switch (*c) {
+		case '"': out << "\\\""; break;
+		case '\\': out << "\\\\"; break;
+		case '\n': out << "\\n"; break;
+		case '\r': out << "\\r"; break;
+		case '\t': out << "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(*c) < 0x20) {
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(*c) << std::dec << std::setfill(' ');
+			}
+			else {
+				out << *c;
+			}
+			break;
+		}
+	}
+	out << '"';
+}
+
+void writeTrace(const std::string& path, uint64_t start, uint64_t end) {
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		std::cerr << "Failed to open " << path << " for the profile capture." << std::endl;
+		return;
+	}
+
+	bool overwritten = false;
+	file << std::fixed << std::setprecision(3);
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	const char* separator = "";
+
+	std::lock_guard<std::mutex> lock(profilerBuffersMtx);
+
+	for (const std::unique_ptr<profilerBuffer>& buffer : profilerBuffers) {
+		file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadId
+			<< ",\"args\":{\"name\":";
+		writeJsonString(file, buffer->threadName.c_str());
+		file << "}}";
+		separator = ",";
+
+		const uint64_t written = buffer->written.load(std::memory_order_acquire);
+		const uint64_t first = written > PROFILER_BUFFER_SIZE ? written - PROFILER_BUFFER_SIZE : 0;
+
+		if (first > 0 && buffer->events[first & (PROFILER_BUFFER_SIZE - 1)].start > start) {
+			overwritten = true;
+		}
+
+		for (uint64_t i = first; i < written; i++) {
+			const profilerEvent& event = buffer->events[i & (PROFILER_BUFFER_SIZE - 1)];
+			if (event.end < start || event.start > end) continue;
+
+			/* the trace is in microseconds, starting with the capture */
+			file << ",{\"name\":";
+			writeJsonString(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadId
+				<< ",\"ts\":" << (static_cast<int64_t>(event.start) - static_cast<int64_t>(start)) / 1000.0
+				<< ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+		}
+	}
+
+	file << "]}";
+
+	if (overwritten) {
+		std::cerr << "The profiler buffers were too small, the start of the capture is missing." << std::endl;
+	}
+}
+
+}
+
+profiler::zone::zone(const char* name) : name(name), start(profilerNow()) {}
+
+profiler::zone::~zone() {
+	const uint64_t end = profilerNow();
+	profilerBuffer& buffer = getLocalProfilerBuffer();
+
+	const uint64_t index = buffer.written.load(std::memory_order_relaxed);
+	buffer.events[index & (PROFILER_BUFFER_SIZE - 1)] = { name, start, end };
+	buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void profiler::setThreadName(const std::string& name) {
+	profilerBuffer& buffer = getLocalProfilerBuffer();
+	std::lock_guard<std::mutex> lock(profilerBuffersMtx);
+	buffer.threadName = name;
+}
+
+void profiler::beginCapture(uint32_t frames, const std::string& path) {
+	if (capture.active || frames == 0) return;
+
+	capture.active = true;
+	capture.frames = frames;
+	capture.framesLeft = frames;
+	capture.start = profilerNow();
+	capture.path = path;
+}
+
+void profiler::endFrame() {
+	if (!capture.active || --capture.framesLeft > 0) return;
+
+	capture.active = false;
+	writeTrace(capture.path, capture.start, profilerNow());
+	std::cout << "Wrote a profile of " << capture.frames << " frames to " << capture.path << std::endl;
+}
+
+#endif
\ No newline at end of file
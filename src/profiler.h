@@ -0,0 +1,64 @@
+/*
+	A scoped CPU profiler.
+
+	PROFILE_SCOPE records how long the rest of the scope took into a ring buffer owned by
+	the calling thread, so recording never takes a lock. A capture of N frames is written
+	as Chrome trace-event JSON, open it in chrome://tracing or ui.perfetto.dev.
+
+	It is on in debug builds and in builds defining ENABLE_PROFILING, everywhere else the
+	macros compile to nothing.
+*/
+
+#pragma once
+
+#if defined(_DEBUG) || defined(ENABLE_PROFILING)
+#define PROFILING_ENABLED 1
+#else
+#define PROFILING_ENABLED 0
+#endif
+
+#if PROFILING_ENABLED
+
+#include <cstdint>
+#include <string>
+
+
+namespace profiler {
+	/* records the time between its construction and destruction, the name has to outlive the program */
+	class zone {
+	private:
+		const char* name;
+		uint64_t start;
+
+	public:
+		explicit zone(const char* name);
+		~zone();
+
+		zone(const zone&) = delete;
+		zone& operator=(const zone&) = delete;
+	};
+
+	/* the name of the calling thread in the trace */
+	void setThreadName(const std::string& name);
+
+	/* writes the zones of the next `frames` frames to path */
+	void beginCapture(uint32_t frames, const std::string& path);
+	void endFrame();
+}
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#define PROFILE_SCOPE(name) profiler::zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) profiler::setThreadName(name)
+#define PROFILE_BEGIN_CAPTURE(frames, path) profiler::beginCapture(frames, path)
+#define PROFILE_END_FRAME() profiler::endFrame()
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#define PROFILE_BEGIN_CAPTURE(frames, path) ((void)0)
+#define PROFILE_END_FRAME() ((void)0)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,351 @@
+#include "renderQueue.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "glDebug.h"
+#include "profiler.h"
+#include "uniformBuffers.h"
+
+
+RenderQueue::RenderQueue()
+	: multiDraw(GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance)
+	, stream(std::make_unique<StreamBuffer>(RENDER_STREAM_SIZE))
+	, instancesOffset(0)
+	, commandsOffset(0)
+{
+	GLint alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	uniformAlignment = std::max<GLsizeiptr>(alignment, 16);
+}
+
+RenderQueue::~RenderQueue() = default;
+
+uint64_t RenderQueue::MakeKey(GLuint program, GLuint vao, uint32_t materialId, uint32_t meshId, float depth, float far) {
+	const float normalizedDepth = far > 0.0f ? std::clamp(depth / far, 0.0f, 1.0f) : 0.0f;
+	const uint64_t quantizedDepth = static_cast<uint64_t>(normalizedDepth * float((1 << 24) - 1));
+
+	return (static_cast<uint64_t>(program & 0xFF) << 56)
+		| (static_cast<uint64_t>(vao & 0xFF) << 48)
+		| (static_cast<uint64_t>(materialId & 0xFFF) << 36)
+		| (static_cast<uint64_t>(meshId & 0xFFF) << 24)
+		| quantizedDepth;
+}
+
+void RenderQueue::Clear() {
+	keys.clear();
+	order.clear();
+	packets.clear();
+}
+
+void RenderQueue::Push(uint64_t key, const drawPacket& packet) {
+	keys.push_back(key);
+	order.push_back(static_cast<uint32_t>(packets.size()));
+	packets.push_back(packet);
+}
+
+void RenderQueue::Resize(size_t count) {
+	keys.resize(count);
+	order.resize(count);
+	packets.resize(count);
+}
+
+void RenderQueue::Set(size_t index, uint64_t key, const drawPacket& packet) {
+	keys[index] = key;
+	order[index] = static_cast<uint32_t>(index);
+	packets[index] = packet;
+}
+
+void RenderQueue::Sort() {
+	PROFILE_SCOPE("RenderQueue::Sort");
+
+	const size_t count = keys.size();
+	if (count < 2) return;
+
+	keysScratch.resize(count);
+	orderScratch.resize(count);
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		std::array<uint32_t, 256> offsets{};
+
+		for (uint64_t key : keys) {
+			offsets[(key >> shift) & 0xFF]++;
+		}
+
+		/* every key has the same byte, the pass wouldn't move anything */
+		if (offsets[(keys[0] >> shift) & 0xFF] == count) continue;
+
+		uint32_t sum = 0;
+		for (uint32_t& offset : offsets) {
+			uint32_t bucket = offset;
+			offset = sum;
+			sum += bucket;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			uint32_t dst = offsets[(keys[i] >> shift) & 0xFF]++;
+			keysScratch[dst] = keys[i];
+			orderScratch[dst] = order[i];
+		}
+
+		keys.swap(keysScratch);
+		order.swap(orderScratch);
+	}
+}
+
+GLsizei RenderQueue::indexSize(GLenum indexType) {
+	return indexType == GL_UNSIGNED_INT ? 4 : indexType == GL_UNSIGNED_SHORT ? 2 : 1;
+}
+
+bool RenderQueue::canInstance(const drawPacket& a, const drawPacket& b) {
+	return canMultiDraw(a, b)
+		&& a.elementCount == b.elementCount
+		&& a.firstIndex == b.firstIndex
+		&& a.baseVertex == b.baseVertex;
+}
+
+bool RenderQueue::canMultiDraw(const drawPacket& a, const drawPacket& b) {
+	return a.shader == b.shader
+		&& a.shader->instancedProgram != 0
+		&& a.materialId != 0 && a.materialId == b.materialId
+		&& a.vao == b.vao
+		&& a.indexType == b.indexType;
+}
+
+void RenderQueue::pushMultiDraw(uint32_t first, uint32_t end) {
+	const uint32_t firstCommand = static_cast<uint32_t>(commands.size());
+	batches.push_back({ first, end - first, static_cast<uint32_t>(instances.size()), firstCommand, 0, 0, 0 });
+
+	/* a command per run of the same mesh, the base instance finds its matrices */
+	for (uint32_t i = first; i < end;) {
+		const drawPacket& packet = packets[order[i]];
+
+		drawElementsIndirectCommand command = {};
+		command.count = static_cast<GLuint>(packet.elementCount);
+		command.firstIndex = packet.firstIndex;
+		command.baseVertex = packet.baseVertex;
+		command.baseInstance = static_cast<GLuint>(instances.size());
+
+		for (; i < end && canInstance(packet, packets[order[i]]); i++) {
+			const drawPacket& instance = packets[order[i]];
+			instances.push_back({ instance.model, instance.normal });
+			command.instanceCount++;
+		}
+
+		commands.push_back(command);
+	}
+
+	batches.back().commandCount = static_cast<uint32_t>(commands.size()) - firstCommand;
+}
+
+void RenderQueue::buildBatches() {
+	batches.clear();
+	instances.clear();
+	commands.clear();
+
+	const uint32_t count = static_cast<uint32_t>(order.size());
+
+	for (uint32_t first = 0; first < count;) {
+		const drawPacket& packet = packets[order[first]];
+
+		if (multiDraw) {
+			uint32_t end = first + 1;
+			while (end < count && canMultiDraw(packet, packets[order[end]])) end++;
+
+			if (end - first >= MIN_INSTANCED_RUN) {
+				pushMultiDraw(first, end);
+				first = end;
+				continue;
+			}
+		}
+
+		uint32_t end = first + 1;
+		while (end < count && canInstance(packet, packets[order[end]])) end++;
+
+		if (end - first >= MIN_INSTANCED_RUN) {
+			batches.push_back({ first, end - first, static_cast<uint32_t>(instances.size()), 0, 0, 0, 0 });
+
+			for (uint32_t i = first; i < end; i++) {
+				const drawPacket& instance = packets[order[i]];
+				instances.push_back({ instance.model, instance.normal });
+			}
+		}
+		else {
+			for (uint32_t i = first; i < end; i++) {
+				batches.push_back({ i, 1, 0, 0, 0, 0, 0 });
+			}
+		}
+
+		first = end;
+	}
+}
+
+/* the rgb values are the first member of Color */
+glm::vec3 rgbOf(const Color& color) {
+	return *reinterpret_cast<const glm::vec3*>(&color);
+}
+
+void RenderQueue::writeFrameData() {
+	PROFILE_SCOPE("RenderQueue::writeFrameData");
+
+	if (!instances.empty()) {
+		const streamAllocation allocation = stream->Allocate(instances.size() * sizeof(instanceData), 16);
+		std::memcpy(allocation.data, instances.data(), instances.size() * sizeof(instanceData));
+		instancesOffset = allocation.offset;
+	}
+	if (!commands.empty()) {
+		const streamAllocation allocation = stream->Allocate(commands.size() * sizeof(drawElementsIndirectCommand), 16);
+		std::memcpy(allocation.data, commands.data(), commands.size() * sizeof(drawElementsIndirectCommand));
+		commandsOffset = allocation.offset;
+	}
+
+	uint32_t writtenMaterial = 0;
+	GLintptr materialOffset = 0;
+
+	for (drawBatch& batch : batches) {
+		const drawPacket& packet = packets[order[batch.first]];
+
+		if (batch.count == 1) {
+			const streamAllocation allocation = stream->Allocate(sizeof(objectBlock), uniformAlignment);
+			objectBlock& block = *static_cast<objectBlock*>(allocation.data);
+			for (int column = 0; column < 4; column++) block.model[column] = glm::vec4(packet.model[column], 0.0f);
+			for (int column = 0; column < 3; column++) block.normal[column] = glm::vec4(packet.normal[column], 0.0f);
+			batch.objectOffset = allocation.offset;
+		}
+
+		/* shared materials are written once per run, the binding outlives program changes */
+		if (packet.materialId == 0 || packet.materialId != writtenMaterial) {
+			const comps::colorMaterial& material = *packet.material;
+
+			const streamAllocation allocation = stream->Allocate(sizeof(materialBlock), uniformAlignment);
+			materialBlock& block = *static_cast<materialBlock*>(allocation.data);
+			block.ambient = glm::vec4(rgbOf(material.ambient), 0.0f);
+			block.diffuse = glm::vec4(rgbOf(material.diffuse), 0.0f);
+			block.specular = rgbOf(material.specular);
+			block.shininess = material.shininess;
+
+			materialOffset = allocation.offset;
+			writtenMaterial = packet.materialId;
+			stats.materialUploads++;
+		}
+		batch.materialOffset = materialOffset;
+	}
+}
+
+void RenderQueue::bindInstances(GLintptr offset) {
+	/* GL 4.1 has no base instance, so the attributes point at the first instance of the batch,
+	   multi draws point at the first instance of the frame and use the base instance of their commands */
+	const GLsizei stride = sizeof(instanceData);
+
+	for (GLuint column = 0; column < 4; column++) {
+		const GLuint location = INSTANCE_ATTRIB_LOCATION + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offset + offsetof(instanceData, model) + column * sizeof(glm::vec3)));
+		glVertexAttribDivisor(location, 1);
+	}
+	for (GLuint column = 0; column < 3; column++) {
+		const GLuint location = INSTANCE_ATTRIB_LOCATION + 4 + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offset + offsetof(instanceData, normal) + column * sizeof(glm::vec3)));
+		glVertexAttribDivisor(location, 1);
+	}
+	stats.instanceAttribBinds += 7;
+}
+
+void RenderQueue::Submit() {
+	PROFILE_SCOPE("RenderQueue::Submit");
+
+	stats = {};
+	stats.packets = static_cast<uint32_t>(packets.size());
+
+	buildBatches();
+
+	/* every allocation may waste up to an alignment */
+	const GLsizeiptr uniformSize = uniformAlignment + std::max<GLsizeiptr>(sizeof(objectBlock), sizeof(materialBlock));
+	const GLsizeiptr frameSize = instances.size() * sizeof(instanceData) + commands.size() * sizeof(drawElementsIndirectCommand)
+		+ 2 * batches.size() * uniformSize + 32;
+
+	stream->BeginFrame(frameSize);
+	writeFrameData();
+	stream->Flush();
+
+	const GLuint buffer = stream->GetBuffer();
+	if (!instances.empty()) glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (!commands.empty()) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+
+	GLuint boundProgram = 0;
+	GLuint boundVao = 0;
+	GLintptr boundMaterial = -1;
+
+	for (const drawBatch& batch : batches) {
+		const drawPacket& packet = packets[order[batch.first]];
+		const comps::shader& prg = *packet.shader;
+
+		const bool multi = batch.commandCount > 0;
+		const bool instanced = batch.count > 1;
+		const GLuint program = instanced ? prg.instancedProgram : prg.program;
+
+		if (program != boundProgram) {
+			GL_CHECK(glUseProgram(program));
+			boundProgram = program;
+			stats.programBinds++;
+		}
+		if (packet.vao != boundVao) {
+			GL_CHECK(glBindVertexArray(packet.vao));
+			boundVao = packet.vao;
+			stats.vaoBinds++;
+		}
+
+		// bind matrices
+		if (instanced) {
+			bindInstances(instancesOffset + (multi ? 0 : batch.firstInstance * sizeof(instanceData)));
+		}
+		else {
+			glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UBO_BINDING, buffer, batch.objectOffset, sizeof(objectBlock));
+			stats.objectBinds++;
+		}
+
+		// bind material
+		if (batch.materialOffset != boundMaterial) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_UBO_BINDING, buffer, batch.materialOffset, sizeof(materialBlock));
+			boundMaterial = batch.materialOffset;
+			stats.materialBinds++;
+		}
+
+		const void* indices = reinterpret_cast<const void*>(static_cast<size_t>(packet.firstIndex) * indexSize(packet.indexType));
+
+		if (multi) {
+			const void* indirect = reinterpret_cast<const void*>(commandsOffset + batch.firstCommand * sizeof(drawElementsIndirectCommand));
+			GL_CHECK(glMultiDrawElementsIndirect(GL_TRIANGLES, packet.indexType, indirect, batch.commandCount, 0));
+			stats.multiDraws++;
+			stats.instances += batch.count;
+		}
+		else if (instanced) {
+			GL_CHECK(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.elementCount, packet.indexType, indices, batch.count, packet.baseVertex));
+			stats.instancedDraws++;
+			stats.instances += batch.count;
+		}
+		else {
+			GL_CHECK(glDrawElementsBaseVertex(GL_TRIANGLES, packet.elementCount, packet.indexType, indices, packet.baseVertex));
+		}
+		stats.draws++;
+	}
+
+	if (boundVao != 0) glBindVertexArray(0);
+	if (boundProgram != 0) glUseProgram(0);
+	if (!instances.empty()) glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (!commands.empty()) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	stream->EndFrame();
+
+	const int64_t binds = int64_t(stats.programBinds) + stats.vaoBinds + stats.materialBinds + stats.objectBinds + stats.instanceAttribBinds;
+	stats.bindsAvoided = static_cast<uint32_t>(std::max<int64_t>(4 * int64_t(stats.packets) - binds, 0));
+}
+
+const renderStats& RenderQueue::GetStats() const {
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,177 @@
+/*
+	Collects the draws of a frame, sorts them by a 64-bit key and submits them
+	changing only the GL state that differs from the previous draw.
+
+	The key, from the most significant bits:
+		program  | 8 bits
+		vao      | 8 bits
+		material | 12 bits
+		mesh     | 12 bits
+		depth    | 24 bits, front to back
+	The key only decides the order, the state changes compare the real GL names,
+	so names that don't fit into their bits cost binds, never correctness.
+
+	Sorted runs of packets sharing the mesh and a shared material are drawn with one
+	glDrawElementsInstancedBaseVertex when the shader has an instanced variant, their
+	matrices go into a per-instance vertex buffer written once per frame.
+
+	Meshes live in geometry arenas, so runs sharing the vao but not the mesh are drawn
+	with one glMultiDrawElementsIndirect instead, when the driver has the
+	ARB_multi_draw_indirect and ARB_base_instance extensions (core in GL 4.3).
+
+	Packets are pushed one by one, or sized up front with Resize and filled by
+	worker threads with Set, only Sort and Submit have to run on the GL thread.
+
+	Everything a frame's draws read, the instances, the indirect commands and the
+	Object and Material blocks, is written linearly into a StreamBuffer before the
+	first draw and bound by offset.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "modelManager/comps/material.h"
+#include "modelManager/comps/shader.h"
+#include "streamBuffer.h"
+
+
+struct drawPacket {
+	const comps::shader* shader;
+	const comps::colorMaterial* material;
+	/* 0 if the material isn't shared, it's uploaded for every draw then */
+	uint32_t materialId;
+
+	GLuint vao;
+	GLsizei elementCount;
+	GLenum indexType;
+	GLint baseVertex;
+	GLuint firstIndex;
+	/* the arena handle, packets with the same one draw the same mesh */
+	uint32_t meshId;
+
+	glm::mat4x3 model;
+	glm::mat3 normal;
+};
+
+/* the per-instance vertex attributes of the instanced shaders */
+struct instanceData {
+	glm::mat4x3 model;
+	glm::mat3 normal;
+};
+
+static_assert(sizeof(instanceData) == 21 * sizeof(float), "instanceData has to be tightly packed");
+
+/* the layout glMultiDrawElementsIndirect reads */
+struct drawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/* the first instance attribute location, model takes 4 and normal 3 */
+constexpr GLuint INSTANCE_ATTRIB_LOCATION = 3;
+/* shorter runs are drawn one by one */
+constexpr uint32_t MIN_INSTANCED_RUN = 4;
+/* the initial size of a frame's region of the stream buffer, it grows when a frame needs more */
+constexpr GLsizeiptr RENDER_STREAM_SIZE = 4 << 20;
+
+struct renderStats {
+	uint32_t packets = 0;
+	/* draw calls, instanced ones included */
+	uint32_t draws = 0;
+	uint32_t instancedDraws = 0;
+	uint32_t instances = 0;
+	/* draw calls using glMultiDrawElementsIndirect */
+	uint32_t multiDraws = 0;
+	uint32_t programBinds = 0;
+	uint32_t vaoBinds = 0;
+	/* material blocks written into the stream buffer */
+	uint32_t materialUploads = 0;
+	/* glBindBufferRange calls for materials */
+	uint32_t materialBinds = 0;
+	/* glBindBufferRange calls for the object blocks of the batches drawn one by one */
+	uint32_t objectBinds = 0;
+	/* glVertexAttribPointer calls pointing the instance attributes at a batch, 7 per instanced batch */
+	uint32_t instanceAttribBinds = 0;
+	/* compared to binding the program, the vao, the material and the object block for every packet,
+	   all of the binds above count */
+	uint32_t bindsAvoided = 0;
+};
+
+class RenderQueue {
+private:
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> order;
+	std::vector<drawPacket> packets;
+
+	std::vector<uint64_t> keysScratch;
+	std::vector<uint32_t> orderScratch;
+
+	/* consecutive sorted packets drawn by a single call */
+	struct drawBatch {
+		uint32_t first;
+		uint32_t count;
+		/* into instances, only used if count > 1 */
+		uint32_t firstInstance;
+		/* into commands, 0 commands if it isn't a multi draw */
+		uint32_t firstCommand;
+		uint32_t commandCount;
+
+		/* in the stream buffer, the object block is only written for single draws */
+		GLintptr objectOffset;
+		GLintptr materialOffset;
+	};
+	std::vector<drawBatch> batches;
+	std::vector<instanceData> instances;
+	std::vector<drawElementsIndirectCommand> commands;
+
+	bool multiDraw;
+
+	std::unique_ptr<StreamBuffer> stream;
+	GLsizeiptr uniformAlignment;
+	GLintptr instancesOffset;
+	GLintptr commandsOffset;
+
+	renderStats stats;
+
+	static GLsizei indexSize(GLenum indexType);
+	static bool canInstance(const drawPacket& a, const drawPacket& b);
+	static bool canMultiDraw(const drawPacket& a, const drawPacket& b);
+	void pushMultiDraw(uint32_t first, uint32_t end);
+	void buildBatches();
+	/* copies the data of the batches into the stream buffer */
+	void writeFrameData();
+	/* offset is where the first instance is in the stream buffer */
+	void bindInstances(GLintptr offset);
+
+public:
+	RenderQueue();
+	~RenderQueue();
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	/* depth is the distance along the view direction, far the farthest one that is sorted */
+	static uint64_t MakeKey(GLuint program, GLuint vao, uint32_t materialId, uint32_t meshId, float depth, float far);
+
+	void Clear();
+	void Push(uint64_t key, const drawPacket& packet);
+	/* makes count packets to be written with Set, many threads may Set different indices at once */
+	void Resize(size_t count);
+	void Set(size_t index, uint64_t key, const drawPacket& packet);
+
+	/* LSD radix sort of the keys, 8 bits a pass, skipping the bytes all keys share */
+	void Sort();
+	void Submit();
+
+	/* of the last Submit */
+	const renderStats& GetStats() const;
+};
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "renderTarget.h"
+
+#include <stdexcept>
+
+#include "glDebug.h"
+
+
+RenderTarget::RenderTarget(int width, int height)
+	: fbo(0)
+	, colorTexture(0)
+	, depthRenderbuffer(0)
+	, width(width)
+	, height(height)
+{
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	glGenTextures(1, &colorTexture);
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+
+	glGenRenderbuffers(1, &depthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+	GL_CHECK(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height));
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		throw std::runtime_error("The render target framebuffer is not complete.");
+	}
+}
+
+RenderTarget::~RenderTarget() {
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(1, &depthRenderbuffer);
+	glDeleteTextures(1, &colorTexture);
+}
+
+void RenderTarget::Bind() const {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, width, height);
+}
+
+GLuint RenderTarget::GetColorTexture() const {
+	return colorTexture;
+}
+
+int RenderTarget::GetWidth() const {
+	return width;
+}
+
+int RenderTarget::GetHeight() const {
+	return height;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+/*
+	A fixed size framebuffer with an RGBA8 color texture and a depth renderbuffer,
+	drawn into instead of the window when there is none to show.
+*/
+
+#pragma once
+
+#include <glad/glad.h>
+
+
+class RenderTarget {
+private:
+	GLuint fbo;
+	GLuint colorTexture;
+	GLuint depthRenderbuffer;
+
+	int width;
+	int height;
+
+public:
+	RenderTarget(int width, int height);
+	~RenderTarget();
+
+	RenderTarget(const RenderTarget&) = delete;
+	RenderTarget& operator=(const RenderTarget&) = delete;
+
+	/* binds the framebuffer and sets the viewport to its size */
+	void Bind() const;
+
+	GLuint GetColorTexture() const;
+	int GetWidth() const;
+	int GetHeight() const;
+};
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+
+Scheduler::Scheduler(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ThreadPool>& threadPool)
+	: registry(registry)
+	, threadPool(threadPool)
+	, built(false)
+	, frames(0)
+{
+	context.registry = registry;
+	context.threadPool = threadPool;
+}
+
+void Scheduler::build() {
+	graph = organizer.graph();
+
+	for (auto prepare : prepares) {
+		prepare(*registry);
+	}
+
+	/* longest path from a top level vertex, the graph is in insertion order so parents come first */
+	std::vector<size_t> depths(graph.size(), 0);
+	for (size_t i = 0; i < graph.size(); i++) {
+		for (size_t child : graph[i].children()) {
+			depths[child] = std::max(depths[child], depths[i] + 1);
+		}
+	}
+
+	levels.clear();
+	for (size_t i = 0; i < graph.size(); i++) {
+		if (depths[i] >= levels.size()) {
+			levels.resize(depths[i] + 1);
+		}
+		levels[depths[i]].push_back(i);
+	}
+
+	timings.assign(graph.size(), timing{});
+	frames = 0;
+	built = true;
+}
+
+void Scheduler::Run(float dt) {
+	if (!built) build();
+
+	context.dt = dt;
+
+	for (const std::vector<size_t>& level : levels) {
+		/* one system per job, the systems split their own work further */
+		threadPool->ParallelFor(level.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				const entt::organizer::vertex& vertex = graph[level[i]];
+
+				auto start = std::chrono::steady_clock::now();
+				vertex.callback()(vertex.data(), *registry);
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				timings[level[i]].lastMs = ms;
+				timings[level[i]].totalMs += ms;
+			}
+		});
+	}
+
+	frames++;
+}
+
+void Scheduler::WriteGraph(std::ostream& out) {
+	if (!built) build();
+
+	entt::adjacency_matrix<entt::directed_tag> matrix(graph.size());
+	for (size_t i = 0; i < graph.size(); i++) {
+		for (size_t child : graph[i].children()) {
+			matrix.insert(i, child);
+		}
+	}
+
+	entt::dot(out, matrix, [this](std::ostream& out, size_t vertex) {
+		out << "label=\"" << (graph[vertex].name() ? graph[vertex].name() : "system") << "\",shape=box";
+	});
+	out << std::endl;
+}
+
+void Scheduler::WriteTimings(std::ostream& out) const {
+	out << "System timings over " << frames << " frames (last / average):" << std::endl;
+
+	for (size_t l = 0; l < levels.size(); l++) {
+		for (size_t i : levels[l]) {
+			const char* name = graph[i].name() ? graph[i].name() : "system";
+			out << "  [" << l << "] " << std::left << std::setw(24) << name << std::right
+				<< std::fixed << std::setprecision(3)
+				<< timings[i].lastMs << " ms / " << (frames ? timings[i].totalMs / frames : 0.0) << " ms" << std::endl;
+		}
+	}
+	out << std::defaultfloat;
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+/*
+	Runs the update systems as a task graph.
+
+	Every system declares which components it reads (const) and writes, entt::organizer
+	turns that into a dependency graph and the systems that don't conflict run in
+	parallel on the thread pool. The graph is split into levels by the longest path to
+	a vertex, the systems in one level run together and every level waits for the
+	previous one.
+*/
+
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+#include "threadPool.h"
+
+
+/* what every system gets when it runs */
+struct frameContext {
+	std::shared_ptr<entt::registry> registry;
+	std::shared_ptr<ThreadPool> threadPool;
+	float dt = 0.0f;
+};
+
+class Scheduler {
+private:
+	struct timing {
+		double lastMs = 0.0;
+		double totalMs = 0.0;
+	};
+
+	std::shared_ptr<entt::registry> registry;
+	std::shared_ptr<ThreadPool> threadPool;
+
+	frameContext context;
+	entt::organizer organizer;
+	/* create the storages of a system, so no system creates one while others are running */
+	std::vector<void (*)(entt::registry&)> prepares;
+
+	std::vector<entt::organizer::vertex> graph;
+	/* vertex indices, a level only depends on the levels before it */
+	std::vector<std::vector<size_t>> levels;
+	bool built;
+
+	std::vector<timing> timings;
+	uint64_t frames;
+
+	void build();
+
+public:
+	Scheduler(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ThreadPool>& threadPool);
+
+	/*
+		Adds System, a void(frameContext&) function, to the graph. Access lists the
+		components it uses, const for read only. Systems conflicting with an earlier
+		one run after it.
+	*/
+	template <auto System, class... Access>
+	void Add(const char* name);
+
+	void Run(float dt);
+
+	/* the task graph in the graphviz dot format */
+	void WriteGraph(std::ostream& out);
+	void WriteTimings(std::ostream& out) const;
+};
+
+template <auto System, class... Access>
+void Scheduler::Add(const char* name) {
+	organizer.emplace<System, Access...>(context, name);
+	prepares.push_back([](entt::registry& registry) {
+		(void(registry.storage<std::remove_const_t<Access>>()), ...);
+	});
+	built = false;
+}
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "shadowMaps.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "constants.h"
+#include "culling.h"
+#include "glDebug.h"
+#include "profiler.h"
+#include "renderQueue.h"
+
+
+ShadowMaps::ShadowMaps(const comps::shader& program, GLuint positionVao)
+	: program(program.program)
+	, lightViewProjLocation(program.location(Uniform::LightViewProj))
+	, positionVao(positionVao)
+	, lightDir(0.0f)
+	, block{}
+	, stream(std::make_unique<StreamBuffer>(SHADOW_STREAM_SIZE))
+{
+	if (lightViewProjLocation == -1) {
+		throw std::runtime_error("The shadow program has no lightViewProj uniform.");
+	}
+
+	depthTexture = createDepthArray();
+	staticTexture = createDepthArray();
+	createLayerFbos(depthTexture, depthFbos);
+	createLayerFbos(staticTexture, staticFbos);
+}
+
+ShadowMaps::~ShadowMaps() {
+	glDeleteFramebuffers(SHADOW_CASCADES, depthFbos.data());
+	glDeleteFramebuffers(SHADOW_CASCADES, staticFbos.data());
+	glDeleteTextures(1, &depthTexture);
+	glDeleteTextures(1, &staticTexture);
+}
+
+GLuint ShadowMaps::createDepthArray() {
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+	GL_CHECK(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADES, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr));
+	/* linear filtering of a compared texture gives 2x2 PCF for free */
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	/* everything outside of a cascade is lit */
+	const float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture;
+}
+
+void ShadowMaps::createLayerFbos(GLuint texture, std::array<GLuint, SHADOW_CASCADES>& fbos) {
+	glGenFramebuffers(SHADOW_CASCADES, fbos.data());
+
+	for (uint32_t layer = 0; layer < SHADOW_CASCADES; layer++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbos[layer]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+
+		const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			throw std::runtime_error("A shadow map framebuffer is not complete.");
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowMaps::Fit(const Camera& camera, const glm::vec3& lightDir) {
+	PROFILE_SCOPE("ShadowMaps::Fit");
+
+	/* a rotated light sees everything from somewhere else */
+	if (lightDir != this->lightDir) {
+		for (cascade& c : cascades) c.fitted = false;
+		this->lightDir = lightDir;
+	}
+
+	const float near = camera.getZNear();
+	const float far = std::min(camera.getZFar(), SHADOW_DISTANCE);
+
+	std::array<float, SHADOW_CASCADES + 1> splits;
+	for (uint32_t i = 0; i <= SHADOW_CASCADES; i++) {
+		const float part = float(i) / SHADOW_CASCADES;
+		const float logarithmic = near * std::pow(far / near, part);
+		const float uniform = near + (far - near) * part;
+		splits[i] = glm::mix(uniform, logarithmic, SHADOW_SPLIT_LAMBDA);
+	}
+
+	/* the corners of the near plane in view space, the ones at depth d are them times d / near */
+	const glm::mat4 inverseProjection = glm::inverse(camera.getProjection());
+	std::array<glm::vec3, 4> nearCorners;
+	for (int i = 0; i < 4; i++) {
+		const glm::vec4 corner = inverseProjection * glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, -1.0f, 1.0f);
+		nearCorners[i] = glm::vec3(corner) / corner.w;
+	}
+
+	const glm::mat4 inverseView = glm::inverse(camera.getView());
+	const glm::vec3 up = std::abs(lightDir.y) > 0.99f ? VEC_FORWARD : VEC_UP;
+	const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDir, up);
+	/* from clip space to texture coordinates and depth */
+	const glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+
+	for (uint32_t c = 0; c < SHADOW_CASCADES; c++) {
+		std::array<glm::vec3, 8> corners;
+		glm::vec3 center(0.0f);
+		for (int i = 0; i < 8; i++) {
+			corners[i] = nearCorners[i % 4] * (splits[c + i / 4] / near);
+			center += corners[i] / 8.0f;
+		}
+
+		float radius = 0.0f;
+		for (const glm::vec3& corner : corners) {
+			radius = std::max(radius, glm::length(corner - center));
+		}
+		/* the corners only move rigidly with the camera, rounding keeps the radius from jittering */
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		fitCascade(c, lightView, glm::vec3(inverseView * glm::vec4(center, 1.0f)), radius);
+
+		const cascade& fitted = cascades[c];
+		block.cascades[c] = bias * fitted.viewProjection * inverseView;
+		block.splits[c] = splits[c + 1];
+		block.normalOffsets[c] = 2.0f * fitted.halfSize / SHADOW_MAP_SIZE * SHADOW_NORMAL_OFFSET;
+	}
+
+	block.count = SHADOW_CASCADES;
+}
+
+void ShadowMaps::fitCascade(uint32_t index, const glm::mat4& lightView, const glm::vec3& center, float radius) {
+	cascade& c = cascades[index];
+
+	const glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+	const float halfSize = radius * (1.0f + SHADOW_CACHE_MARGIN);
+
+	if (c.fitted && c.halfSize == halfSize) {
+		const glm::vec3 offset = glm::abs(lightCenter - c.center) + radius;
+		if (offset.x <= halfSize && offset.y <= halfSize && offset.z <= halfSize) return;
+	}
+
+	/* whole texels, the same geometry lands on the same texels after the move */
+	const float texel = 2.0f * halfSize / SHADOW_MAP_SIZE;
+	c.center = glm::vec3(glm::floor(glm::vec2(lightCenter) / texel) * texel, lightCenter.z);
+	c.halfSize = halfSize;
+
+	/* the light looks down -z, casters up to SHADOW_CASTER_RANGE in front of the box are kept */
+	const glm::mat4 projection = glm::ortho(
+		c.center.x - halfSize, c.center.x + halfSize,
+		c.center.y - halfSize, c.center.y + halfSize,
+		-c.center.z - halfSize - SHADOW_CASTER_RANGE, -c.center.z + halfSize
+	);
+	c.viewProjection = projection * lightView;
+	c.fitted = true;
+	c.staticValid = false;
+}
+
+void ShadowMaps::InvalidateStatic() {
+	for (cascade& c : cascades) c.staticValid = false;
+}
+
+bool ShadowMaps::NeedsStatic(uint32_t cascade) const {
+	return !cascades[cascade].staticValid;
+}
+
+std::array<glm::vec4, 6> ShadowMaps::GetPlanes(uint32_t cascade) const {
+	return culling::extractPlanes(cascades[cascade].viewProjection);
+}
+
+void ShadowMaps::sortCasters(std::vector<shadowCaster>& casters) {
+	std::sort(casters.begin(), casters.end(), [](const shadowCaster& a, const shadowCaster& b) {
+		return std::tie(a.meshId, a.firstIndex, a.elementCount) < std::tie(b.meshId, b.firstIndex, b.elementCount);
+	});
+}
+
+GLintptr ShadowMaps::appendInstances(const std::vector<shadowCaster>& casters) {
+	const GLintptr offset = instances.size() * sizeof(glm::mat4x3);
+	for (const shadowCaster& caster : casters) {
+		instances.push_back(caster.model);
+	}
+	return offset;
+}
+
+static GLsizei indexSize(GLenum indexType) {
+	return indexType == GL_UNSIGNED_INT ? 4 : indexType == GL_UNSIGNED_SHORT ? 2 : 1;
+}
+
+void ShadowMaps::drawCasters(const std::vector<shadowCaster>& casters, GLintptr offset, const glm::mat4& viewProjection) {
+	if (casters.empty()) return;
+
+	glUniformMatrix4fv(lightViewProjLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
+
+	const GLsizei stride = sizeof(glm::mat4x3);
+
+	for (size_t first = 0; first < casters.size();) {
+		const shadowCaster& caster = casters[first];
+
+		size_t end = first + 1;
+		while (end < casters.size() && casters[end].meshId == caster.meshId && casters[end].firstIndex == caster.firstIndex && casters[end].elementCount == caster.elementCount) end++;
+
+		/* no base instance in GL 4.1, the attributes point at the first matrix of the run */
+		const GLintptr runOffset = offset + first * stride;
+		for (GLuint column = 0; column < 4; column++) {
+			const GLuint location = INSTANCE_ATTRIB_LOCATION + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(runOffset + column * sizeof(glm::vec3)));
+			glVertexAttribDivisor(location, 1);
+		}
+
+		const void* indices = reinterpret_cast<const void*>(static_cast<size_t>(caster.firstIndex) * indexSize(caster.indexType));
+		GL_CHECK(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, caster.elementCount, caster.indexType, indices, static_cast<GLsizei>(end - first), caster.baseVertex));
+		stats.draws++;
+
+		first = end;
+	}
+}
+
+void ShadowMaps::Render(std::array<std::vector<shadowCaster>, SHADOW_CASCADES>& statics, std::array<std::vector<shadowCaster>, SHADOW_CASCADES>& dynamics) {
+	PROFILE_SCOPE("ShadowMaps::Render");
+
+	stats = {};
+	instances.clear();
+
+	std::array<GLintptr, SHADOW_CASCADES> staticOffsets{};
+	std::array<GLintptr, SHADOW_CASCADES> dynamicOffsets{};
+
+	for (uint32_t c = 0; c < SHADOW_CASCADES; c++) {
+		if (!cascades[c].staticValid) {
+			sortCasters(statics[c]);
+			staticOffsets[c] = appendInstances(statics[c]);
+			stats.staticCasters += static_cast<uint32_t>(statics[c].size());
+		}
+
+		sortCasters(dynamics[c]);
+		dynamicOffsets[c] = appendInstances(dynamics[c]);
+		stats.dynamicCasters += static_cast<uint32_t>(dynamics[c].size());
+	}
+
+	/* the matrices of every cascade are written at once, before the first draw */
+	const GLsizeiptr size = instances.size() * sizeof(glm::mat4x3);
+	stream->BeginFrame(size + 16);
+
+	GLintptr base = 0;
+	if (!instances.empty()) {
+		const streamAllocation allocation = stream->Allocate(size, 16);
+		std::memcpy(allocation.data, instances.data(), size);
+		base = allocation.offset;
+	}
+	stream->Flush();
+
+	GLint previousFbo = 0;
+	GLint viewport[4];
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.0f, 4.0f);
+
+	glUseProgram(program);
+	glBindVertexArray(positionVao);
+	glBindBuffer(GL_ARRAY_BUFFER, stream->GetBuffer());
+
+	for (uint32_t c = 0; c < SHADOW_CASCADES; c++) {
+		cascade& current = cascades[c];
+
+		if (!current.staticValid) {
+			glBindFramebuffer(GL_FRAMEBUFFER, staticFbos[c]);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			drawCasters(statics[c], base + staticOffsets[c], current.viewProjection);
+
+			current.staticValid = true;
+			stats.staticRedraws++;
+		}
+
+		/* the frame starts from the static casters */
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFbos[c]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFbos[c]);
+		GL_CHECK(glBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST));
+
+		glBindFramebuffer(GL_FRAMEBUFFER, depthFbos[c]);
+		drawCasters(dynamics[c], base + dynamicOffsets[c], current.viewProjection);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+	glUseProgram(0);
+	glDisable(GL_POLYGON_OFFSET_FILL);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	stream->EndFrame();
+}
+
+void ShadowMaps::Bind() const {
+	glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+}
+
+const shadowsBlock& ShadowMaps::GetBlock() const {
+	return block;
+}
+
+const shadowStats& ShadowMaps::GetStats() const {
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+/*
+	Cascaded shadow maps of the first directional light.
+
+	The view frustum up to SHADOW_DISTANCE is split into SHADOW_CASCADES slices, each
+	drawn into a layer of a depth texture array by an orthographic projection along the
+	light. A cascade covers the bounding sphere of its slice with a margin and only moves
+	when the sphere leaves it, by whole texels, so the shadows don't shimmer and the
+	projection stays the same over many frames.
+
+	Static casters are drawn into a second array that is kept while the projection and
+	the static geometry stay the same, every frame starts from a copy of it and only
+	draws the dynamic casters on top. Casters are drawn with the positions of the
+	geometry arena and their model matrices per instance.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "streamBuffer.h"
+#include "uniformBuffers.h"
+#include "modelManager/comps/shader.h"
+
+
+constexpr GLsizei SHADOW_MAP_SIZE = 2048;
+/* the view distance the last cascade ends at, when the far plane is farther */
+constexpr float SHADOW_DISTANCE = 100.0f;
+/* between the uniform (0) and the logarithmic (1) split of the distance */
+constexpr float SHADOW_SPLIT_LAMBDA = 0.75f;
+/* a cascade is this part of its slice's radius larger, so the camera can move before it has to follow */
+constexpr float SHADOW_CACHE_MARGIN = 0.25f;
+/* how far towards the light casters in front of a cascade still throw shadows into it */
+constexpr float SHADOW_CASTER_RANGE = 100.0f;
+/* the lookups move this many texels along the normal, against acne on steep surfaces */
+constexpr float SHADOW_NORMAL_OFFSET = 1.5f;
+/* the initial size of a frame's instance region, it grows when a frame needs more */
+constexpr GLsizeiptr SHADOW_STREAM_SIZE = 1 << 20;
+
+/* a mesh range and where to draw it */
+struct shadowCaster {
+	/* the arena handle, casters with the same one are drawn instanced */
+	uint32_t meshId;
+	GLsizei elementCount;
+	GLenum indexType;
+	GLint baseVertex;
+	GLuint firstIndex;
+
+	glm::mat4x3 model;
+};
+
+struct shadowStats {
+	uint32_t staticCasters = 0;
+	uint32_t dynamicCasters = 0;
+	uint32_t draws = 0;
+	/* cascades whose static cache was drawn again */
+	uint32_t staticRedraws = 0;
+};
+
+class ShadowMaps {
+private:
+	struct cascade {
+		glm::mat4 viewProjection;
+		/* the center of the fitted box in light space */
+		glm::vec3 center;
+		float halfSize;
+		bool fitted = false;
+		/* the static cache holds the casters for viewProjection */
+		bool staticValid = false;
+	};
+
+	GLuint program;
+	GLint lightViewProjLocation;
+	GLuint positionVao;
+
+	GLuint depthTexture;
+	GLuint staticTexture;
+	std::array<GLuint, SHADOW_CASCADES> depthFbos;
+	std::array<GLuint, SHADOW_CASCADES> staticFbos;
+
+	std::array<cascade, SHADOW_CASCADES> cascades;
+	glm::vec3 lightDir;
+	shadowsBlock block;
+
+	std::unique_ptr<StreamBuffer> stream;
+	std::vector<glm::mat4x3> instances;
+	shadowStats stats;
+
+	static GLuint createDepthArray();
+	static void createLayerFbos(GLuint texture, std::array<GLuint, SHADOW_CASCADES>& fbos);
+	/* by mesh and range, so the runs of the same range are drawn instanced */
+	static void sortCasters(std::vector<shadowCaster>& casters);
+	/* the byte offset of the casters' matrices in instances */
+	GLintptr appendInstances(const std::vector<shadowCaster>& casters);
+
+	void fitCascade(uint32_t index, const glm::mat4& lightView, const glm::vec3& center, float radius);
+	/* offset is where the matrices of the casters start in the stream buffer */
+	void drawCasters(const std::vector<shadowCaster>& casters, GLintptr offset, const glm::mat4& viewProjection);
+
+public:
+	/* program is the position only shader, positionVao the position stream of the geometry arena */
+	ShadowMaps(const comps::shader& program, GLuint positionVao);
+	~ShadowMaps();
+
+	ShadowMaps(const ShadowMaps&) = delete;
+	ShadowMaps& operator=(const ShadowMaps&) = delete;
+
+	/* moves the cascades that no longer hold their slice of the camera frustum, lightDir is normalized in world space */
+	void Fit(const Camera& camera, const glm::vec3& lightDir);
+	/* the static casters changed, every cache has to be drawn again */
+	void InvalidateStatic();
+	bool NeedsStatic(uint32_t cascade) const;
+	/* the planes casters of a cascade have to be inside of */
+	std::array<glm::vec4, 6> GetPlanes(uint32_t cascade) const;
+
+	/* the casters of every cascade, statics are only drawn for the cascades that need them */
+	void Render(std::array<std::vector<shadowCaster>, SHADOW_CASCADES>& statics, std::array<std::vector<shadowCaster>, SHADOW_CASCADES>& dynamics);
+	/* binds the depth array to SHADOW_TEXTURE_UNIT */
+	void Bind() const;
+
+	/* count is 0 until the first Fit */
+	const shadowsBlock& GetBlock() const;
+	const shadowStats& GetStats() const;
+};
\ No newline at end of file
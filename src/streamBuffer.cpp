@@ -0,0 +1,137 @@
+#include "streamBuffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "glDebug.h"
+#include "profiler.h"
+
+
+/* a second, long enough that waiting longer means the GPU is stuck */
+constexpr GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+
+StreamBuffer::StreamBuffer(GLsizeiptr frameSize)
+	: buffer(0)
+	, persistent(GLAD_GL_ARB_buffer_storage)
+	, frameSize(0)
+	, head(0)
+	, frame(0)
+	, mapped(nullptr)
+	, fences{}
+{
+	create(frameSize);
+}
+
+StreamBuffer::~StreamBuffer() {
+	destroy();
+}
+
+void StreamBuffer::create(GLsizeiptr size) {
+	frameSize = size;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+	if (persistent) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GL_CHECK(glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * STREAM_BUFFER_FRAMES, nullptr, flags));
+		mapped = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * STREAM_BUFFER_FRAMES, flags));
+		if (mapped == nullptr) {
+			throw std::runtime_error("Failed to map the stream buffer.");
+		}
+	}
+	else {
+		GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, frameSize, nullptr, GL_STREAM_DRAW));
+		staging.resize(frameSize);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::destroy() {
+	for (uint32_t region = 0; region < STREAM_BUFFER_FRAMES; region++) {
+		waitForRegion(region);
+	}
+
+	if (mapped != nullptr) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mapped = nullptr;
+	}
+
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
+
+void StreamBuffer::waitForRegion(uint32_t region) {
+	GLsync& fence = fences[region];
+	if (fence == nullptr) return;
+
+	PROFILE_SCOPE("StreamBuffer::waitForRegion");
+
+	/* the first wait flushes, so the fence surely reaches the GPU */
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (true) {
+		const GLenum result = glClientWaitSync(fence, flags, FENCE_TIMEOUT_NS);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) break;
+		if (result == GL_WAIT_FAILED) {
+			throw std::runtime_error("Waiting for a stream buffer fence failed.");
+		}
+		flags = 0;
+	}
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void StreamBuffer::BeginFrame(GLsizeiptr size) {
+	if (size > frameSize) {
+		/* the buffer can't grow in place while the GPU reads it, a new one replaces it */
+		destroy();
+		create(std::max(size, frameSize * 2));
+	}
+
+	frame = persistent ? (frame + 1) % STREAM_BUFFER_FRAMES : 0;
+	head = 0;
+
+	if (persistent) waitForRegion(frame);
+}
+
+streamAllocation StreamBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment) {
+	const GLsizeiptr start = (head + alignment - 1) & ~(alignment - 1);
+	if (start + size > frameSize) {
+		throw std::runtime_error("The stream buffer region is full, reserve more in BeginFrame.");
+	}
+	head = start + size;
+
+	if (persistent) {
+		const GLintptr offset = frame * frameSize + start;
+		return { mapped + offset, offset };
+	}
+	return { staging.data() + start, start };
+}
+
+void StreamBuffer::Flush() {
+	if (persistent || head == 0) return;
+
+	/* orphaning gives the buffer a new store, the draws of the last frame keep the old one */
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	GL_CHECK(glBufferData(GL_COPY_WRITE_BUFFER, frameSize, nullptr, GL_STREAM_DRAW));
+	GL_CHECK(glBufferSubData(GL_COPY_WRITE_BUFFER, 0, head, staging.data()));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::EndFrame() {
+	if (persistent) {
+		fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+GLuint StreamBuffer::GetBuffer() const {
+	return buffer;
+}
+
+bool StreamBuffer::IsPersistent() const {
+	return persistent;
+}
\ No newline at end of file
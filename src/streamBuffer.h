@@ -0,0 +1,67 @@
+/*
+	A ring buffer for data written by the CPU once per frame and read by the GPU in the
+	same frame, split into a region per frame in flight.
+
+	With ARB_buffer_storage the whole buffer is mapped persistent and coherent once,
+	allocations are written in place and a fence after every frame keeps the CPU from
+	writing a region the GPU may still read. GL 4.1 without the extension gets a single
+	region, written to memory and uploaded into an orphaned store by Flush.
+
+	Allocations are linear and only live until the end of the frame.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+
+constexpr uint32_t STREAM_BUFFER_FRAMES = 3;
+
+struct streamAllocation {
+	void* data;
+	/* where the data is in the buffer, to bind it by offset */
+	GLintptr offset;
+};
+
+class StreamBuffer {
+private:
+	GLuint buffer;
+	bool persistent;
+
+	/* the size of a region */
+	GLsizeiptr frameSize;
+	GLsizeiptr head;
+	uint32_t frame;
+
+	/* the persistent mapping of the whole buffer */
+	uint8_t* mapped;
+	std::array<GLsync, STREAM_BUFFER_FRAMES> fences;
+	/* the frame's data without the persistent mapping */
+	std::vector<uint8_t> staging;
+
+	void create(GLsizeiptr size);
+	void destroy();
+	void waitForRegion(uint32_t region);
+
+public:
+	explicit StreamBuffer(GLsizeiptr frameSize);
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	/* waits until the GPU is done with the next region, which grows to hold at least size bytes */
+	void BeginFrame(GLsizeiptr size);
+	/* alignment has to be a power of two */
+	streamAllocation Allocate(GLsizeiptr size, GLsizeiptr alignment);
+	/* makes the allocations visible to the GPU, call before the draws reading them */
+	void Flush();
+	void EndFrame();
+
+	GLuint GetBuffer() const;
+	bool IsPersistent() const;
+};
\ No newline at end of file
@@ -1,41 +1,58 @@
 #include "systems.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <SDL2/SDL.h>
+#include <algorithm>
 #include <iostream>
-#include <stack>
-#include <unordered_set>
-#include <sstream>
+#include <limits>
 
+#include "culling.h"
+#include "occlusion.h"
+#include "hierarchy.h"
+#include "profiler.h"
+#include "transformKernel.h"
+
+#include "comps/boundsProxy.h"
 #include "comps/child.h"
 #include "comps/scale.h"
 #include "comps/transform.h"
 #include "comps/dynamicallyScaled.h"
 #include "comps/orbiting.h"
 #include "comps/light.h"
+#include "comps/shadowCaster.h"
+#include "modelManager/comps/occluder.h"
 
 
 void systems::orbitPos(const std::shared_ptr<entt::registry>& registry) {
+	PROFILE_SCOPE("systems::orbitPos");
+
 	auto view = registry->view<const comps::orbiting, comps::position>();
 	
 	for (auto [entity, orbit, pos] : view.each()) {
 		const glm::vec3 scale = glm::pi<float>() / orbit.duration;
 		pos.pos = orbit.amplitude * glm::sin((SDL_GetTicks64() / 1000.0f) * scale + orbit.phase) + orbit.center;
+		registry->patch<comps::position>(entity);
 	}
 }
 
 void systems::keyboardMove(const std::shared_ptr<entt::registry>& registry, float dt) {
+	PROFILE_SCOPE("systems::keyboardMove");
+
 	keyboardMoveInAxis<Axis::X>(registry, dt);
 	keyboardMoveInAxis<Axis::Y>(registry, dt);
 	keyboardMoveInAxis<Axis::Z>(registry, dt);
 }
 
 void systems::keyboardRotate(const std::shared_ptr<entt::registry>& registry, float dt) {
+	PROFILE_SCOPE("systems::keyboardRotate");
+
 	keyboardRotateAroundAngle<EAngle::YAW>(registry, dt);
 	keyboardRotateAroundAngle<EAngle::PITCH>(registry, dt);
 	keyboardRotateAroundAngle<EAngle::ROLL>(registry, dt);
 }
 
 void systems::dynamicallyScale(const std::shared_ptr<entt::registry>& registry) {
+	PROFILE_SCOPE("systems::dynamicallyScale");
+
 	auto view = registry->view<comps::scale, const comps::dynamicallyScaled>();
 	for (auto [e, scale, dynScale] : view.each()) {
 		glm::vec3 lerpFactor = glm::mod(glm::vec3(SDL_GetTicks64() / 1000.0f), dynScale.duration) / dynScale.duration;
@@ -47,203 +64,741 @@ void systems::dynamicallyScale(const std::shared_ptr<entt::registry>& registry)
 		lerpFactor *= 2.0f;
 
 		scale.scl = glm::mix(dynScale.start, dynScale.end, lerpFactor);
+		registry->patch<comps::scale>(e);
 	}
 }
 
 /* Render */
 
-void systems::calcTransforms(const std::shared_ptr<entt::registry>& registry) {
-	auto view = registry->view<comps::transform, const comps::position, const comps::orientation, const comps::scale>();
+/* reused every frame, so the transform systems don't allocate */
+struct transformScratch {
+	/* entities whose local matrix has to be recalculated */
+	std::vector<entt::entity> dirty;
+	/* their position, orientation, center and scale as structure of arrays */
+	std::vector<float> soa;
+	std::vector<glm::mat4x3> composed;
+	/* entities whose world matrix has to be recalculated, by depth */
+	std::vector<std::vector<entt::entity>> levels{ 1 };
+	/* entities whose normal matrix needs the full inverse, with their world matrices */
+	std::vector<entt::entity> skewed;
+	std::vector<glm::mat4x3> skewedWorlds;
+	std::vector<glm::mat3> skewedNormals;
+};
+
+/* entities per job of the transform systems */
+constexpr size_t TRANSFORM_GRAIN_SIZE = 1024;
+
+void markTransformDirty(entt::registry& registry, entt::entity entity) {
+	registry.emplace_or_replace<comps::transformDirty>(entity);
+}
+
+/* the systems patching a Component declare comps::changed<Component> as written, calcTransforms merges them */
+template <class Component>
+void markChanged(entt::registry& registry, entt::entity entity) {
+	registry.emplace_or_replace<comps::changed<Component>>(entity);
+}
 
-	for (auto [e, transform, pos, rot, scl] : view.each()) {
-		transform.matrix =
-			  glm::translate(glm::mat4(1.0f), pos.pos + rot.center)
-			* glm::mat4_cast(rot.orient)
-			* glm::translate(glm::mat4(1.0f), -rot.center)
-			* glm::scale(glm::mat4(1.0f), scl.scl);
+template <class Component>
+void mergeChanged(entt::registry& registry) {
+	for (entt::entity entity : registry.storage<comps::changed<Component>>()) {
+		registry.emplace_or_replace<comps::transformDirty>(entity);
 	}
+	registry.clear<comps::changed<Component>>();
 }
 
-void systems::clearTransformCache(const std::shared_ptr<entt::registry>& registry) {
-	auto view = registry->view<comps::child>();
+void systems::initTransformTracking(const std::shared_ptr<entt::registry>& registry) {
+	registry->ctx().emplace<transformScratch>();
+	/* the pool has to exist before the signals fire, they also fire while entities are being destroyed */
+	registry->storage<comps::transformDirty>();
+	registry->storage<comps::changed<comps::position>>();
+	registry->storage<comps::changed<comps::orientation>>();
+	registry->storage<comps::changed<comps::scale>>();
+
+	registry->on_construct<comps::position>().connect<&markChanged<comps::position>>();
+	registry->on_update<comps::position>().connect<&markChanged<comps::position>>();
+	registry->on_construct<comps::orientation>().connect<&markChanged<comps::orientation>>();
+	registry->on_update<comps::orientation>().connect<&markChanged<comps::orientation>>();
+	registry->on_construct<comps::scale>().connect<&markChanged<comps::scale>>();
+	registry->on_update<comps::scale>().connect<&markChanged<comps::scale>>();
+	registry->on_construct<comps::localTransform>().connect<&markTransformDirty>();
+	/* a new parent means a new absolute transform */
+	registry->on_construct<comps::child>().connect<&markTransformDirty>();
+	registry->on_update<comps::child>().connect<&markTransformDirty>();
+}
 
-	for (auto [e, child] : view.each()) {
-		child.hasBeenCalculated = false;
-	}
+void systems::calcTransforms(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ThreadPool>& threadPool) {
+	PROFILE_SCOPE("systems::calcTransforms");
+
+	transformScratch& scratch = registry->ctx().get<transformScratch>();
+
+	mergeChanged<comps::position>(*registry);
+	mergeChanged<comps::orientation>(*registry);
+	mergeChanged<comps::scale>(*registry);
+
+	auto view = registry->view<const comps::position, const comps::orientation, const comps::scale, const comps::transformDirty, comps::localTransform>();
+	scratch.dirty.assign(view.begin(), view.end());
+
+	const size_t count = scratch.dirty.size();
+	scratch.soa.resize(13 * count);
+	scratch.composed.resize(count);
+
+	auto& positions = registry->storage<comps::position>();
+	auto& orientations = registry->storage<comps::orientation>();
+	auto& scales = registry->storage<comps::scale>();
+	auto& locals = registry->storage<comps::localTransform>();
+
+	/* every entity writes only its own matrix, so the chunks are independent */
+	threadPool->ParallelFor(count, TRANSFORM_GRAIN_SIZE, [&](size_t begin, size_t end) {
+		PROFILE_SCOPE("calcTransforms job");
+
+		/* the kernel reads structure of arrays, one array per float */
+		float* soa = scratch.soa.data();
+		auto array = [soa, count, begin](size_t index) { return soa + index * count + begin; };
+
+		for (size_t i = begin; i < end; i++) {
+			const entt::entity e = scratch.dirty[i];
+
+			const comps::position& pos = positions.get(e);
+			const comps::orientation& rot = orientations.get(e);
+			const comps::scale& scl = scales.get(e);
+
+			soa[0 * count + i] = pos.pos.x;
+			soa[1 * count + i] = pos.pos.y;
+			soa[2 * count + i] = pos.pos.z;
+			soa[3 * count + i] = rot.orient.x;
+			soa[4 * count + i] = rot.orient.y;
+			soa[5 * count + i] = rot.orient.z;
+			soa[6 * count + i] = rot.orient.w;
+			soa[7 * count + i] = rot.center.x;
+			soa[8 * count + i] = rot.center.y;
+			soa[9 * count + i] = rot.center.z;
+			soa[10 * count + i] = scl.scl.x;
+			soa[11 * count + i] = scl.scl.y;
+			soa[12 * count + i] = scl.scl.z;
+		}
+
+		const transformKernel::input in = {
+			array(0), array(1), array(2),
+			array(3), array(4), array(5), array(6),
+			array(7), array(8), array(9),
+			array(10), array(11), array(12)
+		};
+		transformKernel::compose(in, end - begin, scratch.composed.data() + begin);
+
+		for (size_t i = begin; i < end; i++) {
+			locals.get(scratch.dirty[i]).matrix = scratch.composed[i];
+		}
+	});
 }
 
-void systems::calcAbsoluteTransform(const std::shared_ptr<entt::registry>& registry) {
-	auto view = registry->view<comps::child, comps::transform>();
+void systems::calcAbsoluteTransform(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ThreadPool>& threadPool) {
+	PROFILE_SCOPE("systems::calcAbsoluteTransform");
 
-	for (auto [entity, child, transform] : view.each()) {
-		if (child.hasBeenCalculated) continue;
-		
-		/* a matrix stack for computing absolute transform of this child */
-		std::stack<comps::transform*> matrixStack;
-		/* an absolute parent */
-		glm::mat4 baseMatrix;
+	transformScratch& scratch = registry->ctx().get<transformScratch>();
 
-		/* a set for handling circular parent-child hierarchy */
-		std::unordered_set<entt::entity> visitedEntities;
-		
-		entt::entity currEntity = entity;
+	for (std::vector<entt::entity>& level : scratch.levels) {
+		level.clear();
+	}
 
-		/* load parent entities */
-		while (true) {
-			if (visitedEntities.find(currEntity) != visitedEntities.end()) {
-				/* circular hierarchy */
-				throw std::runtime_error("Entity parent-child hierarchy is circular.");
-			}
-			visitedEntities.insert(currEntity);
-
-			if (!registry->all_of<comps::transform>(currEntity)) {
-				/* perform a step "back" to last child, because this parent
-				   shan't be used as base */
-				/* cannot fail, the matrix stack will always have at least
-				   the starting child, that will always have transform
-				   component */
-				baseMatrix = matrixStack.top()->matrix;
-				matrixStack.pop();
-			}
+	auto& children = registry->storage<comps::child>();
+	auto& locals = registry->storage<comps::localTransform>();
+	auto& worlds = registry->storage<comps::worldTransform>();
+	auto& dirty = registry->storage<comps::transformDirty>();
 
-			comps::transform* currTransform = &registry->get<comps::transform>(currEntity);
-			comps::child* currChild;
+	/* collect the entities to update by depth, every depth only depends on the previous one */
+	auto queue = [&](entt::entity entity) {
+		if (!worlds.contains(entity)) return;
 
-			if (!registry->all_of<comps::child>(currEntity) || (currChild = &registry->get<comps::child>(currEntity))->hasBeenCalculated) {
-				/* absolute or precalculated parent found, se it as the base */
-				baseMatrix = currTransform->matrix;
-				break;
-			}
+		const uint32_t depth = children.contains(entity) ? children.get(entity).depth : 0;
 
-			/* to be calculated */
-			matrixStack.push(currTransform);
-			/* mark as calculated */
-			currChild->hasBeenCalculated = true;
-			/* propagate to the next parent */
-			currEntity = currChild->parent;
+		if (depth >= scratch.levels.size()) {
+			scratch.levels.resize(depth + 1);
 		}
+		scratch.levels[depth].push_back(entity);
+	};
 
-		/* calculate the stack */
-		while (!matrixStack.empty()) {
-			comps::transform* t = matrixStack.top();
-			t->matrix = baseMatrix = baseMatrix * t->matrix;
-			matrixStack.pop();
+	auto hasDirtyAncestor = [&](entt::entity entity) {
+		for (const comps::child* child = children.contains(entity) ? &children.get(entity) : nullptr; child; child = children.contains(child->parent) ? &children.get(child->parent) : nullptr) {
+			if (dirty.contains(child->parent)) return true;
 		}
+		return false;
+	};
+
+	for (entt::entity entity : dirty) {
+		/* every subtree is queued once, from its topmost dirty entity */
+		if (hasDirtyAncestor(entity)) continue;
+
+		queue(entity);
+		hierarchy::forEachDescendant(*registry, entity, queue);
+	}
+
+	for (const std::vector<entt::entity>& level : scratch.levels) {
+		threadPool->ParallelFor(level.size(), TRANSFORM_GRAIN_SIZE, [&](size_t begin, size_t end) {
+			PROFILE_SCOPE("calcAbsoluteTransform job");
+
+			for (size_t i = begin; i < end; i++) {
+				const entt::entity entity = level[i];
+				const glm::mat4x3& local = locals.get(entity).matrix;
+
+				/* an entity without a transform breaks the chain, its children are treated as roots */
+				const comps::child* child = children.contains(entity) ? &children.get(entity) : nullptr;
+
+				worlds.get(entity).matrix = child && worlds.contains(child->parent)
+					? affine::multiply(worlds.get(child->parent).matrix, local)
+					: local;
+			}
+		});
 	}
+
+	registry->clear<comps::transformDirty>();
 }
 
-void setDirLightUniforms(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ModelManager>& modelMngr) {
-	auto view = registry->view<const comps::dirLight, const comps::lightEmitter, const comps::orientation>();
+/* the box around the transformed mesh bounds */
+aabb worldBox(const Bounds& bounds, const glm::mat4x3& model) {
+	const glm::vec3 center = model * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f);
+	const glm::vec3 halfSize = (bounds.max - bounds.min) * 0.5f;
+	const glm::vec3 extent = glm::mat3(glm::abs(model[0]), glm::abs(model[1]), glm::abs(model[2])) * halfSize;
+
+	return { center - extent, center + extent };
+}
+
+void removeBoundsProxy(entt::registry& registry, entt::entity entity) {
+	registry.ctx().get<AabbTree>().Remove(registry.get<comps::boundsProxy>(entity).proxy);
+}
+
+/* a new mesh has new bounds, insertBoundsProxies gives the entity a new leaf */
+void resetBoundsProxy(entt::registry& registry, entt::entity entity) {
+	registry.remove<comps::boundsProxy>(entity);
+}
+
+void systems::initBoundsTree(const std::shared_ptr<entt::registry>& registry) {
+	registry->ctx().emplace<AabbTree>();
+	registry->on_destroy<comps::boundsProxy>().connect<&removeBoundsProxy>();
+	registry->on_update<comps::mesh>().connect<&resetBoundsProxy>();
+}
+
+void systems::initOcclusion(const std::shared_ptr<entt::registry>& registry) {
+	registry->ctx().emplace<OcclusionBuffer>();
+}
 
-	for (const auto& [shaderId, shader] : modelMngr->GetShaders()) {
-		if (!shader.requireLights) continue;
-		glUseProgram(shader.program);
+/* set when static casters come or go, the ones that moved are found in the transform levels */
+struct shadowTracking {
+	bool staticChanged = true;
+};
 
-		uint32_t i = 0;
+/* the casters of every cascade, reused between frames */
+struct shadowScratch {
+	std::array<std::vector<shadowCaster>, SHADOW_CASCADES> statics;
+	std::array<std::vector<shadowCaster>, SHADOW_CASCADES> dynamics;
+};
 
-		for (auto [entity, light, orient] : view.each()) {
-			std::stringstream ss;
-			ss << "dirLights[" << i++ << "]";
-			std::string locName = ss.str();
+void markStaticShadowsChanged(entt::registry& registry, entt::entity) {
+	registry.ctx().get<shadowTracking>().staticChanged = true;
+}
+
+void systems::initShadows(const std::shared_ptr<entt::registry>& registry) {
+	registry->ctx().emplace<shadowTracking>();
+	registry->ctx().emplace<shadowScratch>();
+	registry->on_construct<comps::staticShadowCaster>().connect<&markStaticShadowsChanged>();
+	registry->on_destroy<comps::staticShadowCaster>().connect<&markStaticShadowsChanged>();
+}
+
+void systems::updateBoundsTree(const std::shared_ptr<entt::registry>& registry) {
+	PROFILE_SCOPE("systems::updateBoundsTree");
+
+	AabbTree& tree = registry->ctx().get<AabbTree>();
+	const transformScratch& scratch = registry->ctx().get<transformScratch>();
+
+	auto& meshes = registry->storage<comps::mesh>();
+	auto& worlds = registry->storage<comps::worldTransform>();
+	auto& proxies = registry->storage<comps::boundsProxy>();
+
+	/* only the entities whose world matrix changed this frame can leave their leaf */
+	for (const std::vector<entt::entity>& level : scratch.levels) {
+		for (entt::entity entity : level) {
+			if (!proxies.contains(entity)) continue;
+
+			tree.Update(proxies.get(entity).proxy, worldBox(meshes.get(entity).bounds, worlds.get(entity).matrix));
+		}
+	}
+}
+
+void systems::insertBoundsProxies(const std::shared_ptr<entt::registry>& registry) {
+	PROFILE_SCOPE("systems::insertBoundsProxies");
+
+	AabbTree& tree = registry->ctx().get<AabbTree>();
+
+	auto& meshes = registry->storage<comps::mesh>();
+	auto& worlds = registry->storage<comps::worldTransform>();
+
+	auto added = registry->view<const comps::mesh, const comps::worldTransform>(entt::exclude<comps::boundsProxy>);
+	std::vector<entt::entity> entities(added.begin(), added.end());
+
+	for (entt::entity entity : entities) {
+		const int32_t proxy = tree.Insert(worldBox(meshes.get(entity).bounds, worlds.get(entity).matrix), static_cast<uint32_t>(entt::to_integral(entity)));
+		registry->emplace<comps::boundsProxy>(entity, proxy);
+	}
+}
+
+entt::entity systems::pickEntity(const std::shared_ptr<entt::registry>& registry, const glm::vec3& origin, const glm::vec3& dir) {
+	PROFILE_SCOPE("systems::pickEntity");
 
-			glm::vec3 dir = orient.orient * VEC_DOWN;
+	AabbTree& tree = registry->ctx().get<AabbTree>();
 
-			GLint directionLoc = glGetUniformLocation(shader.program, (locName + ".dir").c_str());
-			GLint ambientLoc = glGetUniformLocation(shader.program, (locName + ".ambient").c_str());
-			GLint diffuseLoc = glGetUniformLocation(shader.program, (locName + ".diffuse").c_str());
-			GLint specularLoc = glGetUniformLocation(shader.program, (locName + ".specular").c_str());
+	entt::entity closest = entt::null;
+	float closestT = std::numeric_limits<float>::max();
 
-			glUniform3fv(directionLoc, 1, glm::value_ptr(dir));
-			glUniform3fv(ambientLoc, 1, glm::value_ptr(light.color.toVec3() * light.ambient));
-			glUniform3fv(diffuseLoc, 1, glm::value_ptr(light.color.toVec3() * light.diffuse));
-			glUniform3fv(specularLoc, 1, glm::value_ptr(light.color.toVec3() * light.specular));
+	tree.QueryRay(origin, dir, closestT, [&](uint32_t userData, float tEnter) {
+		if (tEnter < closestT) {
+			closestT = tEnter;
+			closest = static_cast<entt::entity>(userData);
+		}
+		return closestT;
+	});
+
+	return closest;
+}
+
+/* relative to the squared length of the columns */
+constexpr float UNIFORM_SCALE_EPSILON = 1e-4f;
+
+/* the linear part is a rotation times a uniform scale */
+bool hasUniformScale(const glm::mat4x3& m, float& scaleSquared) {
+	scaleSquared = glm::dot(m[0], m[0]);
+	const float epsilon = UNIFORM_SCALE_EPSILON * scaleSquared;
+
+	return std::abs(glm::dot(m[1], m[1]) - scaleSquared) <= epsilon
+		&& std::abs(glm::dot(m[2], m[2]) - scaleSquared) <= epsilon
+		&& std::abs(glm::dot(m[0], m[1])) <= epsilon
+		&& std::abs(glm::dot(m[1], m[2])) <= epsilon
+		&& std::abs(glm::dot(m[2], m[0])) <= epsilon;
+}
+
+void systems::calcNormalMatrices(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ThreadPool>& threadPool) {
+	PROFILE_SCOPE("systems::calcNormalMatrices");
+
+	transformScratch& scratch = registry->ctx().get<transformScratch>();
+	scratch.skewed.clear();
+	scratch.skewedWorlds.clear();
+
+	auto& worlds = registry->storage<comps::worldTransform>();
+	auto& normals = registry->storage<comps::normalTransform>();
 
-			GLenum err;
-			while ((err = glGetError()) != GL_NO_ERROR) {
-				std::cerr << "OpenGL error (during setting dir lights): " << err << std::endl;
+	/* (s * R)^-T is R / s, the same as s * R / s^2 */
+	for (const std::vector<entt::entity>& level : scratch.levels) {
+		for (entt::entity entity : level) {
+			if (!normals.contains(entity)) continue;
+
+			const glm::mat4x3& world = worlds.get(entity).matrix;
+
+			float scaleSquared;
+			if (hasUniformScale(world, scaleSquared) && scaleSquared > 0.0f) {
+				normals.get(entity).matrix = glm::mat3(world[0], world[1], world[2]) / scaleSquared;
+			}
+			else {
+				scratch.skewed.push_back(entity);
+				scratch.skewedWorlds.push_back(world);
 			}
 		}
+	}
+
+	const size_t count = scratch.skewed.size();
+	scratch.skewedNormals.resize(count);
 
-		GLint numLightsLoc = glGetUniformLocation(shader.program, "numDirLights");
+	threadPool->ParallelFor(count, TRANSFORM_GRAIN_SIZE, [&](size_t begin, size_t end) {
+		PROFILE_SCOPE("calcNormalMatrices job");
 
-		if (numLightsLoc != -1) {
-			glUniform1ui(numLightsLoc, i);
+		transformKernel::normalMatrices(scratch.skewedWorlds.data() + begin, end - begin, scratch.skewedNormals.data() + begin);
+
+		for (size_t i = begin; i < end; i++) {
+			normals.get(scratch.skewed[i]).matrix = scratch.skewedNormals[i];
 		}
+	});
+}
 
+/* the point and spot lights of the frame, reused between frames */
+struct lightScratch {
+	std::vector<localLight> lights;
+};
+
+void systems::initLights(const std::shared_ptr<entt::registry>& registry) {
+	registry->ctx().emplace<lightScratch>();
+}
+
+void setDirLightUniforms(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::unique_ptr<UniformBuffers>& uniformBuffers) {
+	PROFILE_SCOPE("setDirLightUniforms");
+
+	auto view = registry->view<const comps::dirLight, const comps::lightEmitter, const comps::orientation>();
+
+	/* the shaders light in view space */
+	const glm::mat3 toViewSpace = glm::mat3(camera->getView());
+
+	dirLightsBlock block{};
+
+	for (auto [entity, light, orient] : view.each()) {
+		if (block.count == MAX_DIR_LIGHTS) break;
+
+		dirLightBlock& dirLight = block.lights[block.count++];
+
+		dirLight.dir = glm::vec4(toViewSpace * (orient.orient * VEC_DOWN), 0.0f);
+		dirLight.ambient = glm::vec4(light.color.toVec3() * light.ambient, 0.0f);
+		dirLight.diffuse = glm::vec4(light.color.toVec3() * light.diffuse, 0.0f);
+		dirLight.specular = glm::vec4(light.color.toVec3() * light.specular, 0.0f);
 	}
-	glUseProgram(0);
+
+	uniformBuffers->UploadDirLights(block);
 }
 
 
-void setLightUniforms(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ModelManager>& modelMngr) {
-	setDirLightUniforms(registry, modelMngr);
+void setLocalLights(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::unique_ptr<UniformBuffers>& uniformBuffers, const std::unique_ptr<LightClusters>& lightClusters, const std::shared_ptr<ThreadPool>& threadPool) {
+	PROFILE_SCOPE("setLocalLights");
+
+	std::vector<localLight>& lights = registry->ctx().get<lightScratch>().lights;
+	lights.clear();
+
+	auto points = registry->view<const comps::pointLight, const comps::lightEmitter, const comps::worldTransform>();
+	for (auto [entity, point, light, world] : points.each()) {
+		lights.push_back({
+			world.matrix[3], point.range,
+			VEC_DOWN, -1.0f, -2.0f,
+			light.color.toVec3(), light.ambient, light.diffuse, light.specular
+		});
+	}
+
+	auto spots = registry->view<const comps::spotLight, const comps::lightEmitter, const comps::worldTransform>();
+	for (auto [entity, spot, light, world] : spots.each()) {
+		lights.push_back({
+			world.matrix[3], spot.range,
+			glm::normalize(glm::mat3(world.matrix) * VEC_DOWN), std::cos(glm::radians(spot.innerAngle)), std::cos(glm::radians(spot.outerAngle)),
+			light.color.toVec3(), light.ambient, light.diffuse, light.specular
+		});
+	}
+
+	lightClusters->Build(*camera, lights, threadPool);
+	lightClusters->Upload();
+	lightClusters->Bind();
+	uniformBuffers->UploadClusters(lightClusters->GetBlock());
 }
 
-void setCameraUniforms(const std::unique_ptr<Camera>& camera, const std::shared_ptr<ModelManager>& modelMngr) {
-	// TODO: use uniform buffers
-	for (const auto& [shaderId, shader] : modelMngr->GetShaders()) {
-		GLenum err;
-		while ((err = glGetError()) != GL_NO_ERROR);
-	
-		glUseProgram(shader.program);
-		
-		glUniformMatrix4fv(shader.viewUnifLoc, 1, GL_FALSE, glm::value_ptr(camera->getView()));
-		glUniformMatrix4fv(shader.projUnifLoc, 1, GL_FALSE, glm::value_ptr(camera->getProjection()));
+void setLightUniforms(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::unique_ptr<UniformBuffers>& uniformBuffers, const std::unique_ptr<LightClusters>& lightClusters, const std::shared_ptr<ThreadPool>& threadPool) {
+	setDirLightUniforms(registry, camera, uniformBuffers);
+	setLocalLights(registry, camera, uniformBuffers, lightClusters, threadPool);
+}
 
+void setCameraUniforms(const std::unique_ptr<Camera>& camera, const std::unique_ptr<UniformBuffers>& uniformBuffers) {
+	PROFILE_SCOPE("setCameraUniforms");
 
-		while ((err = glGetError()) != GL_NO_ERROR) {
-			std::cerr << "OpenGL error (during setting camera matrices): " << err << std::endl;
-		}
+	cameraBlock block{};
+	block.view = camera->getView();
+	block.proj = camera->getProjection();
+	block.viewProj = block.proj * block.view;
+
+	uniformBuffers->UploadCamera(block);
+}
+
+void renderShadows(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::unique_ptr<UniformBuffers>& uniformBuffers, const std::unique_ptr<ShadowMaps>& shadowMaps, const lodSettings& lods, const culling::frustum& frustum) {
+	PROFILE_SCOPE("renderShadows");
+
+	/* the first light of setDirLightUniforms casts the shadows */
+	auto lights = registry->view<const comps::dirLight, const comps::lightEmitter, const comps::orientation>();
+	if (lights.begin() == lights.end()) {
+		uniformBuffers->UploadShadows(shadowsBlock{});
+		return;
+	}
+	const glm::vec3 lightDir = glm::normalize(lights.get<const comps::orientation>(*lights.begin()).orient * VEC_DOWN);
+
+	shadowTracking& tracking = registry->ctx().get<shadowTracking>();
+	const transformScratch& transforms = registry->ctx().get<transformScratch>();
+	auto& statics = registry->storage<comps::staticShadowCaster>();
+
+	for (const std::vector<entt::entity>& level : transforms.levels) {
+		if (tracking.staticChanged) break;
+		tracking.staticChanged = std::any_of(level.begin(), level.end(), [&statics](entt::entity entity) { return statics.contains(entity); });
+	}
+	if (tracking.staticChanged) {
+		shadowMaps->InvalidateStatic();
+		tracking.staticChanged = false;
 	}
-	glUseProgram(0);
+
+	shadowMaps->Fit(*camera, lightDir);
+
+	shadowScratch& scratch = registry->ctx().get<shadowScratch>();
+
+	AabbTree& tree = registry->ctx().get<AabbTree>();
+	auto& meshes = registry->storage<comps::mesh>();
+	auto& worlds = registry->storage<comps::worldTransform>();
+	auto& levels = registry->storage<comps::lodLevel>();
+
+	for (uint32_t c = 0; c < SHADOW_CASCADES; c++) {
+		scratch.statics[c].clear();
+		scratch.dynamics[c].clear();
+
+		const bool needsStatic = shadowMaps->NeedsStatic(c);
+
+		tree.QueryFrustum(shadowMaps->GetPlanes(c), [&](uint32_t userData) {
+			const entt::entity entity = static_cast<entt::entity>(userData);
+			const bool isStatic = statics.contains(entity);
+			if (isStatic && !needsStatic) return;
+
+			/* the cache outlives the level the camera picks, so static casters are drawn in full */
+			const comps::mesh& mesh = meshes.get(entity);
+			const glm::mat4x3& world = worlds.get(entity).matrix;
+
+			/* the level the camera would pick, selectLods only updates the casters it sees */
+			uint32_t level = 0;
+			if (!isStatic && levels.contains(entity)) {
+				const glm::vec4 sphere = culling::transformSphere(mesh.bounds, world);
+				const float depth = glm::dot(glm::vec3(frustum.depth), glm::vec3(sphere)) + frustum.depth.w;
+				const float scale = mesh.bounds.radius > 0.0f ? sphere.w / mesh.bounds.radius : 1.0f;
+
+				level = culling::selectLod(frustum, lods, mesh.lods.data(), mesh.lodCount, levels.get(entity).level, scale, depth);
+			}
+			const MeshLod& lod = mesh.lods[level];
+
+			const shadowCaster caster = {
+				mesh.geometry, static_cast<GLsizei>(lod.indexCount), mesh.indexType,
+				mesh.baseVertex, mesh.firstIndex + lod.firstIndex,
+				world
+			};
+			(isStatic ? scratch.statics[c] : scratch.dynamics[c]).push_back(caster);
+		});
+	}
+
+	shadowMaps->Render(scratch.statics, scratch.dynamics);
+	uniformBuffers->UploadShadows(shadowMaps->GetBlock());
+	shadowMaps->Bind();
 }
 
-void renderEntities(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera) {
-	auto view = registry->view<const comps::mesh, const comps::shader, const comps::transform, const comps::colorMaterial>();
-	for (auto [entity, mesh, prg, transform, material] : view.each()) {
-		GLenum err;
-		while ((err = glGetError()) != GL_NO_ERROR);
+/* a box test projects 8 corners and may scan many depth pixels, far more work than a transform, so fewer per job */
+constexpr size_t OCCLUSION_GRAIN_SIZE = 256;
+/* building a packet is about as much work as a transform */
+constexpr size_t QUEUE_GRAIN_SIZE = 1024;
+
+/* the world space spheres of the entities the bounds tree found and what culling made of them, reused between frames */
+struct cullScratch {
+	/* the renderable entities whose leaf touches the frustum, the results are in this order */
+	std::vector<entt::entity> entities;
+	std::vector<float> x, y, z, radius;
+	std::vector<culling::result> results;
+	culling::frustum frustum;
+
+	/* the entities left for the occlusion test, by their index in entities */
+	std::vector<uint32_t> candidates;
+	std::vector<aabb> boxes;
+
+	/* the entities left after culling */
+	std::vector<entt::entity> visible;
+};
+
+void systems::initCulling(const std::shared_ptr<entt::registry>& registry) {
+	registry->ctx().emplace<cullScratch>();
+}
+
+static bool isVisible(culling::result result) {
+	return result == culling::result::Intersecting || result == culling::result::Inside;
+}
+
+void cullEntities(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, cullScratch& scratch, cullStats& stats) {
+	PROFILE_SCOPE("cullEntities");
+
+	auto renderable = registry->view<const comps::mesh, const comps::shader, const comps::worldTransform, const comps::colorMaterial>();
+	auto& meshes = registry->storage<comps::mesh>();
+	auto& worlds = registry->storage<comps::worldTransform>();
+	AabbTree& tree = registry->ctx().get<AabbTree>();
+
+	scratch.frustum = culling::makeFrustum(camera->getFrustumPlanes(), camera->getView(), camera->getProjection(), MIN_SCREEN_SIZE);
+	const culling::frustum& frustum = scratch.frustum;
+
+	/* the tree rejects whole subtrees, only the leaves it reaches are tested one by one */
+	scratch.entities.clear();
+	tree.QueryFrustum(frustum.planes, [&](uint32_t userData) {
+		const entt::entity entity = static_cast<entt::entity>(userData);
+		if (renderable.contains(entity)) scratch.entities.push_back(entity);
+	});
+
+	const size_t count = scratch.entities.size();
+	scratch.x.resize(count);
+	scratch.y.resize(count);
+	scratch.z.resize(count);
+	scratch.radius.resize(count);
+	scratch.results.resize(count);
+
+	for (size_t i = 0; i < count; i++) {
+		const entt::entity entity = scratch.entities[i];
+		const glm::vec4 sphere = culling::transformSphere(meshes.get(entity).bounds, worlds.get(entity).matrix);
+		scratch.x[i] = sphere.x;
+		scratch.y[i] = sphere.y;
+		scratch.z[i] = sphere.z;
+		scratch.radius[i] = sphere.w;
+	}
 
-		glUseProgram(prg.program);
-		while ((err = glGetError()) != GL_NO_ERROR) {
-			std::cerr << "OpenGL error (glUseProgram): " << err << std::endl;
+	culling::testSpheres(frustum, { scratch.x.data(), scratch.y.data(), scratch.z.data(), scratch.radius.data() }, count, scratch.results.data());
+
+	stats = {};
+	stats.tested = static_cast<uint32_t>(count);
+
+	/* a sphere crossing a plane may still be far from the box */
+	for (size_t i = 0; i < count; i++) {
+		const entt::entity entity = scratch.entities[i];
+		culling::result& result = scratch.results[i];
+
+		if (result == culling::result::Intersecting && !culling::testBox(frustum, meshes.get(entity).bounds, worlds.get(entity).matrix)) {
+			result = culling::result::Outside;
 		}
-		glBindVertexArray(mesh.vao);
-		while ((err = glGetError()) != GL_NO_ERROR) {
-			std::cerr << "OpenGL error (glBindVertexArray): " << err << std::endl;
+
+		switch (result) {
+		case culling::result::Outside:
+			stats.frustumCulled++;
+			break;
+		case culling::result::TooSmall:
+			stats.smallCulled++;
+			break;
+		default:
+			stats.visible++;
+			break;
 		}
+	}
+}
+
+void occludeEntities(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::shared_ptr<ThreadPool>& threadPool, cullScratch& scratch, cullStats& stats) {
+	PROFILE_SCOPE("occludeEntities");
+
+	OcclusionBuffer& buffer = registry->ctx().get<OcclusionBuffer>();
+	buffer.BeginFrame(camera->getProjection() * camera->getView());
+
+	scratch.candidates.clear();
+	scratch.boxes.clear();
+
+	auto& meshes = registry->storage<comps::mesh>();
+	auto& worlds = registry->storage<comps::worldTransform>();
+	auto& occluders = registry->storage<comps::occluder>();
 
-		// set matrices
-		glm::mat3 normalMat = glm::mat3(glm::transpose(glm::inverse(camera->getView() * transform.matrix)));
+	for (uint32_t index = 0; index < scratch.entities.size(); index++) {
+		if (!isVisible(scratch.results[index])) continue;
 
-		glUniformMatrix4fv(prg.modelUnifLoc, 1, GL_FALSE, glm::value_ptr(transform.matrix));
-		glUniformMatrix3fv(prg.normalUnifLoc, 1, GL_FALSE, glm::value_ptr(normalMat));
-		while ((err = glGetError()) != GL_NO_ERROR) {
-			std::cerr << "OpenGL error (during setting matrices): " << err << std::endl;
+		const entt::entity entity = scratch.entities[index];
+		const glm::mat4x3& world = worlds.get(entity).matrix;
+
+		if (occluders.contains(entity)) {
+			buffer.AddOccluder(*occluders.get(entity).mesh, world);
 		}
 
-		// TODO: use uniform buffers
-		// set material
-		glUniform1f(glGetUniformLocation(prg.program, "material.shininess"), material.shininess);
-		glUniform3fv(glGetUniformLocation(prg.program, "material.ambient"), 1, reinterpret_cast<const float*>(&material.ambient));
-		glUniform3fv(glGetUniformLocation(prg.program, "material.diffuse"), 1, reinterpret_cast<const float*>(&material.diffuse));
-		glUniform3fv(glGetUniformLocation(prg.program, "material.specular"), 1, reinterpret_cast<const float*>(&material.specular));
-		while ((err = glGetError()) != GL_NO_ERROR) {
-			std::cerr << "OpenGL error (during setting material): " << err << std::endl;
+		scratch.candidates.push_back(index);
+		scratch.boxes.push_back(worldBox(meshes.get(entity).bounds, world));
+	}
+
+	stats.occluderTriangles = buffer.GetTriangleCount();
+	buffer.Rasterize(threadPool);
+
+	/* every test writes only its own result */
+	threadPool->ParallelFor(scratch.candidates.size(), OCCLUSION_GRAIN_SIZE, [&buffer, &scratch](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; c++) {
+			if (!buffer.TestBox(scratch.boxes[c])) scratch.results[scratch.candidates[c]] = culling::result::Occluded;
 		}
+	});
 
-		glDrawElements(GL_TRIANGLES, mesh.elementCount, mesh.indexType, 0);
-		while ((err = glGetError()) != GL_NO_ERROR) {
-			std::cerr << "OpenGL error (during render): " << err << std::endl;
+	for (uint32_t index : scratch.candidates) {
+		if (scratch.results[index] == culling::result::Occluded) {
+			stats.visible--;
+			stats.occlusionCulled++;
 		}
+	}
+}
+
+void selectLods(const std::shared_ptr<entt::registry>& registry, const lodSettings& lods, const cullScratch& scratch, cullStats& stats) {
+	PROFILE_SCOPE("selectLods");
+
+	auto& meshes = registry->storage<comps::mesh>();
+	auto& levels = registry->storage<comps::lodLevel>();
+	const culling::frustum& frustum = scratch.frustum;
+
+	for (size_t index = 0; index < scratch.entities.size(); index++) {
+		const entt::entity entity = scratch.entities[index];
+		if (!isVisible(scratch.results[index]) || !levels.contains(entity)) continue;
+
+		const comps::mesh& mesh = meshes.get(entity);
+
+		/* the level stays the same while culled, so hysteresis holds when it comes back */
+		const glm::vec3 center(scratch.x[index], scratch.y[index], scratch.z[index]);
+		const float depth = glm::dot(glm::vec3(frustum.depth), center) + frustum.depth.w;
+		const float scale = mesh.bounds.radius > 0.0f ? scratch.radius[index] / mesh.bounds.radius : 1.0f;
+
+		uint32_t& level = levels.get(entity).level;
+		level = culling::selectLod(frustum, lods, mesh.lods.data(), mesh.lodCount, level, scale, depth);
+		stats.lods[level]++;
+	}
+}
+
+void queueEntities(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::shared_ptr<ThreadPool>& threadPool, cullScratch& scratch, const std::unique_ptr<RenderQueue>& renderQueue) {
+	PROFILE_SCOPE("queueEntities");
+
+	const glm::mat4x3 view = affine::fromMat4(camera->getView());
+	const float far = camera->getZFar();
 
-		glBindVertexArray(0);
-		glUseProgram(0);
+	scratch.visible.clear();
+
+	for (size_t i = 0; i < scratch.entities.size(); i++) {
+		if (isVisible(scratch.results[i])) scratch.visible.push_back(scratch.entities[i]);
 	}
+
+	renderQueue->Clear();
+	renderQueue->Resize(scratch.visible.size());
+
+	auto& meshes = registry->storage<comps::mesh>();
+	auto& shaders = registry->storage<comps::shader>();
+	auto& worlds = registry->storage<comps::worldTransform>();
+	auto& materials = registry->storage<comps::colorMaterial>();
+	auto& normals = registry->storage<comps::normalTransform>();
+	auto& levels = registry->storage<comps::lodLevel>();
+
+	/* the workers only read the registry and every packet has its own slot, the GL thread submits after */
+	threadPool->ParallelFor(scratch.visible.size(), QUEUE_GRAIN_SIZE, [&](size_t begin, size_t end) {
+		PROFILE_SCOPE("queueEntities::job");
+
+		for (size_t v = begin; v < end; v++) {
+			const entt::entity entity = scratch.visible[v];
+			const comps::mesh& mesh = meshes.get(entity);
+			const comps::shader& prg = shaders.get(entity);
+			const comps::worldTransform& world = worlds.get(entity);
+			const comps::colorMaterial& material = materials.get(entity);
+
+			const MeshLod& lod = mesh.lods[levels.contains(entity) ? levels.get(entity).level : 0];
+
+			drawPacket packet{};
+			packet.shader = &prg;
+			packet.material = &material;
+			packet.materialId = material.id;
+			packet.vao = mesh.vao;
+			packet.elementCount = static_cast<GLsizei>(lod.indexCount);
+			packet.indexType = mesh.indexType;
+			packet.baseVertex = mesh.baseVertex;
+			packet.firstIndex = mesh.firstIndex + lod.firstIndex;
+			packet.meshId = mesh.geometry;
+			packet.model = world.matrix;
+			packet.normal = normals.contains(entity) ? normals.get(entity).matrix : affine::normalMatrix(world.matrix);
+
+			/* the camera looks down -z */
+			const float depth = -affine::transformPoint(view, world.matrix[3]).z;
+
+			renderQueue->Set(v, RenderQueue::MakeKey(prg.program, mesh.vao, material.id, mesh.geometry, depth, far), packet);
+		}
+	});
 }
 
-void systems::render(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::shared_ptr<ModelManager>& modelMngr) {
-	setLightUniforms(registry, modelMngr);
-	setCameraUniforms(camera, modelMngr);
-	renderEntities(registry, camera);
+void systems::render(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::unique_ptr<UniformBuffers>& uniformBuffers, const std::unique_ptr<RenderQueue>& renderQueue, const std::unique_ptr<ShadowMaps>& shadowMaps, const std::unique_ptr<LightClusters>& lightClusters, const std::shared_ptr<ThreadPool>& threadPool, const lodSettings& lods, cullStats& cullingStats) {
+	PROFILE_SCOPE("systems::render");
+
+	cullScratch& scratch = registry->ctx().get<cullScratch>();
+
+	setLightUniforms(registry, camera, uniformBuffers, lightClusters, threadPool);
+	setCameraUniforms(camera, uniformBuffers);
+
+	cullEntities(registry, camera, scratch, cullingStats);
+	occludeEntities(registry, camera, threadPool, scratch, cullingStats);
+	selectLods(registry, lods, scratch, cullingStats);
+	/* after selectLods, so the dynamic casters the camera sees are drawn with this frame's level */
+	renderShadows(registry, camera, uniformBuffers, shadowMaps, lods, scratch.frustum);
+	queueEntities(registry, camera, threadPool, scratch, renderQueue);
+	renderQueue->Sort();
+	renderQueue->Submit();
 }
\ No newline at end of file
@@ -6,7 +6,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/euler_angles.hpp>
 
+#include "aabbTree.h"
 #include "camera.h"
+#include "threadPool.h"
+#include "uniformBuffers.h"
+#include "renderQueue.h"
+#include "culling.h"
+#include "shadowMaps.h"
+#include "lightClusters.h"
 #include "modelManager/modelManager.h"
 
 #include "comps/position.h"
@@ -28,11 +35,31 @@ namespace systems {
 
 	void dynamicallyScale(const std::shared_ptr<entt::registry>& registry);
 
-	void calcTransforms(const std::shared_ptr<entt::registry>& registry);
-	void clearTransformCache(const std::shared_ptr<entt::registry>& registry);
-	void calcAbsoluteTransform(const std::shared_ptr<entt::registry>& registry);
-
-	void render(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::shared_ptr<ModelManager>& modelMngr);
+	/* connects the signals that mark entities with a changed transform as dirty */
+	void initTransformTracking(const std::shared_ptr<entt::registry>& registry);
+	void calcTransforms(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ThreadPool>& threadPool);
+	void calcAbsoluteTransform(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ThreadPool>& threadPool);
+	/* updates the normal matrices of the entities calcAbsoluteTransform updated */
+	void calcNormalMatrices(const std::shared_ptr<entt::registry>& registry, const std::shared_ptr<ThreadPool>& threadPool);
+
+	/* puts an AabbTree of the world space mesh bounds into the registry context */
+	void initBoundsTree(const std::shared_ptr<entt::registry>& registry);
+	/* moves the leaves of the entities calcAbsoluteTransform updated */
+	void updateBoundsTree(const std::shared_ptr<entt::registry>& registry);
+	/* inserts leaves for new or replaced meshes, adds components so it runs outside the scheduler */
+	void insertBoundsProxies(const std::shared_ptr<entt::registry>& registry);
+	/* puts what render culls the entities with in the registry context */
+	void initCulling(const std::shared_ptr<entt::registry>& registry);
+	/* puts the OcclusionBuffer render draws the occluders into in the registry context */
+	void initOcclusion(const std::shared_ptr<entt::registry>& registry);
+	/* tracks the static shadow casters, so the cascades know when their caches are stale */
+	void initShadows(const std::shared_ptr<entt::registry>& registry);
+	/* puts the list render collects the point and spot lights into in the registry context */
+	void initLights(const std::shared_ptr<entt::registry>& registry);
+	/* the entity whose leaf box the ray enters first, entt::null if none */
+	entt::entity pickEntity(const std::shared_ptr<entt::registry>& registry, const glm::vec3& origin, const glm::vec3& dir);
+
+	void render(const std::shared_ptr<entt::registry>& registry, const std::unique_ptr<Camera>& camera, const std::unique_ptr<UniformBuffers>& uniformBuffers, const std::unique_ptr<RenderQueue>& renderQueue, const std::unique_ptr<ShadowMaps>& shadowMaps, const std::unique_ptr<LightClusters>& lightClusters, const std::shared_ptr<ThreadPool>& threadPool, const lodSettings& lods, cullStats& cullingStats);
 }
 
 template <Axis A>
@@ -72,6 +99,10 @@ void systems::keyboardMoveInAxis(const std::shared_ptr<entt::registry>& registry
 		if (state[ctrl.dec]) {
 			pos.pos -= vector * speed * dt;
 		}
+
+		if (state[ctrl.inc] || state[ctrl.dec]) {
+			registry->patch<comps::position>(entity);
+		}
 	}
 }
 
@@ -100,6 +131,8 @@ void systems::keyboardRotateAroundAngle(const std::shared_ptr<entt::registry>& r
 			break;
 		}
 
+		if (!state[ctrl.inc] && !state[ctrl.dec]) continue;
+
 		glm::quat offset = glm::angleAxis(0.0f, axis);
 
 		if (state[ctrl.inc]) {
@@ -115,5 +148,7 @@ void systems::keyboardRotateAroundAngle(const std::shared_ptr<entt::registry>& r
 		else {
 			rot.orient = offset * rot.orient;
 		}
+
+		registry->patch<comps::orientation>(entity);
 	}
 }
\ No newline at end of file
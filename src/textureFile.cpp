@@ -0,0 +1,56 @@
+#include "textureFile.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "glDebug.h"
+
+
+void saveColorTextureToFile(GLuint textureID, int width, int height, const std::string& filename) {
+	const size_t pitch = static_cast<size_t>(width) * 4;
+	std::vector<unsigned char> buffer(pitch * height);
+
+	// Bind the texture and read its data into the buffer
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	GL_CHECK(glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data()));
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// GL starts with the bottom row, images with the top one
+	std::vector<unsigned char> row(pitch);
+	for (int y = 0; y < height / 2; y++) {
+		unsigned char* top = buffer.data() + y * pitch;
+		unsigned char* bottom = buffer.data() + (height - 1 - y) * pitch;
+		std::memcpy(row.data(), top, pitch);
+		std::memcpy(top, bottom, pitch);
+		std::memcpy(bottom, row.data(), pitch);
+	}
+
+	// Create an SDL_Surface from the buffer
+	SDL_Surface* surface = SDL_CreateRGBSurfaceFrom(
+		buffer.data(),
+		width,
+		height,
+		32, // 32 bits depth
+		static_cast<int>(pitch),
+		0x000000FF, // R mask
+		0x0000FF00, // G mask
+		0x00FF0000, // B mask
+		0xFF000000  // A mask
+	);
+	if (surface == nullptr) {
+		throw std::runtime_error(std::string("Failed to create a surface for ") + filename + ": " + SDL_GetError());
+	}
+
+	// Save the surface to a PNG file using SDL2_image
+	const int result = IMG_SavePNG(surface, filename.c_str());
+	SDL_FreeSurface(surface);
+
+	if (result != 0) {
+		throw std::runtime_error(std::string("Failed to save ") + filename + ": " + IMG_GetError());
+	}
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+#include <glad/glad.h>
+
+
+/* writes the RGBA8 level 0 of the texture to a PNG, the top row first */
+void saveColorTextureToFile(GLuint textureID, int width, int height, const std::string& filename);
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "threadPool.h"
+
+#include <algorithm>
+#include <string>
+
+#include "profiler.h"
+
+
+thread_local int ThreadPool::workerIndex = -1;
+
+unsigned int ThreadPool::DefaultWorkerCount() {
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+}
+
+ThreadPool::ThreadPool(unsigned int workerCount)
+	: queuedJobs(0)
+	, stopping(false)
+{
+	for (unsigned int i = 0; i < workerCount; i++) {
+		workers.push_back(std::make_unique<Worker>());
+	}
+	for (unsigned int i = 0; i < workerCount; i++) {
+		threads.emplace_back(&ThreadPool::workerLoop, this, static_cast<int>(i));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMtx);
+		stopping = true;
+	}
+	sleepCv.notify_all();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+unsigned int ThreadPool::GetConcurrency() const {
+	return static_cast<unsigned int>(workers.size()) + 1;
+}
+
+void ThreadPool::workerLoop(int index) {
+	workerIndex = index;
+	PROFILE_THREAD_NAME("worker " + std::to_string(index));
+
+	while (true) {
+		if (tryRunJob(index)) continue;
+
+		std::unique_lock<std::mutex> lock(sleepMtx);
+		sleepCv.wait(lock, [this] { return stopping || queuedJobs.load() > 0; });
+
+		if (stopping) return;
+	}
+}
+
+void ThreadPool::push(const Job& job, size_t workerHint) {
+	Worker& worker = *workers[workerHint % workers.size()];
+
+	/* counted before it can be popped, so the counter never drops below zero */
+	queuedJobs.fetch_add(1);
+
+	std::lock_guard<std::mutex> lock(worker.mtx);
+	worker.jobs.push_back(job);
+}
+
+bool ThreadPool::pop(int index, Job& job) {
+	Worker& worker = *workers[index];
+	std::lock_guard<std::mutex> lock(worker.mtx);
+
+	if (worker.jobs.empty()) return false;
+
+	job = worker.jobs.back();
+	worker.jobs.pop_back();
+	queuedJobs.fetch_sub(1);
+	return true;
+}
+
+bool ThreadPool::steal(int thief, Job& job) {
+	const size_t count = workers.size();
+	/* start with the next worker, so the thieves don't all fight over the first deque */
+	const size_t start = thief < 0 ? 0 : static_cast<size_t>(thief) + 1;
+
+	for (size_t i = 0; i < count; i++) {
+		Worker& victim = *workers[(start + i) % count];
+		std::lock_guard<std::mutex> lock(victim.mtx);
+
+		if (victim.jobs.empty()) continue;
+
+		job = victim.jobs.front();
+		victim.jobs.pop_front();
+		queuedJobs.fetch_sub(1);
+		return true;
+	}
+
+	return false;
+}
+
+bool ThreadPool::tryRunJob(int index) {
+	Job job;
+
+	if (!(index >= 0 && pop(index, job)) && !steal(index, job)) {
+		return false;
+	}
+
+	job.func(job.context, job.begin, job.end);
+	job.pending->fetch_sub(1, std::memory_order_acq_rel);
+	return true;
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grainSize, void (*func)(const void*, size_t, size_t), const void* context) {
+	grainSize = std::max<size_t>(grainSize, 1);
+	const size_t jobCount = (count + grainSize - 1) / grainSize;
+
+	std::atomic<size_t> pending(jobCount);
+
+	/* spread the jobs over the deques, the thieves balance the rest */
+	for (size_t i = 0; i < jobCount; i++) {
+		const size_t begin = i * grainSize;
+		push({ func, context, begin, std::min(begin + grainSize, count), &pending }, i);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMtx);
+	}
+	sleepCv.notify_all();
+
+	while (pending.load(std::memory_order_acquire) > 0) {
+		if (!tryRunJob(workerIndex)) {
+			std::this_thread::yield();
+		}
+	}
+}
\ No newline at end of file
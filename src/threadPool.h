@@ -0,0 +1,91 @@
+/*
+	A work-stealing thread pool.
+
+	Every worker owns a deque of jobs: it pops its own jobs from the back and,
+	when it runs out, steals from the front of the other workers' deques. The thread
+	that waits for a batch of jobs doesn't sleep, it steals and runs jobs as well,
+	so ParallelFor can also be called from inside a job.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+class ThreadPool {
+private:
+	struct Job {
+		void (*func)(const void* context, size_t begin, size_t end);
+		const void* context;
+		size_t begin;
+		size_t end;
+		std::atomic<size_t>* pending;
+	};
+
+	struct Worker {
+		std::mutex mtx;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+
+	std::mutex sleepMtx;
+	std::condition_variable sleepCv;
+	std::atomic<size_t> queuedJobs;
+	bool stopping;
+
+	/* the index of the worker running on this thread, or -1 on the other threads */
+	static thread_local int workerIndex;
+
+	void workerLoop(int index);
+
+	void push(const Job& job, size_t workerHint);
+	bool pop(int index, Job& job);
+	bool steal(int thief, Job& job);
+	bool tryRunJob(int index);
+
+	void parallelFor(size_t count, size_t grainSize, void (*func)(const void*, size_t, size_t), const void* context);
+
+public:
+	/* one worker per hardware thread, except the one the pool is used from */
+	static unsigned int DefaultWorkerCount();
+
+	/* 0 worker threads makes every call run on the calling thread */
+	explicit ThreadPool(unsigned int workerCount = DefaultWorkerCount());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/* the number of threads working on a ParallelFor, including the calling one */
+	unsigned int GetConcurrency() const;
+
+	/*
+		Calls func(begin, end) for consecutive ranges of at most grainSize indices
+		covering [0, count) and returns once all of them have finished.
+	*/
+	template <class Func>
+	void ParallelFor(size_t count, size_t grainSize, const Func& func);
+};
+
+template <class Func>
+void ThreadPool::ParallelFor(size_t count, size_t grainSize, const Func& func) {
+	if (count == 0) return;
+
+	if (workers.empty() || count <= grainSize) {
+		func(size_t(0), count);
+		return;
+	}
+
+	parallelFor(count, grainSize, [](const void* context, size_t begin, size_t end) {
+		(*static_cast<const Func*>(context))(begin, end);
+	}, &func);
+}
\ No newline at end of file
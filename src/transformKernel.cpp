@@ -0,0 +1,413 @@
+#include "transformKernel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_KERNEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+/* MSVC allows AVX2 intrinsics in any function */
+#define TARGET_AVX2
+#else
+/* no fma, fused multiply-adds would round differently from the scalar remainder */
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define TRANSFORM_KERNEL_X86 0
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////////////////
+/*      SCALAR                                                                         */
+/////////////////////////////////////////////////////////////////////////////////////////
+
+static void composeScalar(const transformKernel::input& in, size_t begin, size_t end, glm::mat4x3* out) {
+	for (size_t i = begin; i < end; i++) {
+		const float x = in.qx[i], y = in.qy[i], z = in.qz[i], w = in.qw[i];
+		const float cx = in.cx[i], cy = in.cy[i], cz = in.cz[i];
+
+		const float xx = x * x, yy = y * y, zz = z * z;
+		const float xy = x * y, xz = x * z, yz = y * z;
+		const float wx = w * x, wy = w * y, wz = w * z;
+
+		/* the rotation matrix, rXY is column X row Y */
+		const float r00 = 1.0f - 2.0f * (yy + zz), r01 = 2.0f * (xy + wz), r02 = 2.0f * (xz - wy);
+		const float r10 = 2.0f * (xy - wz), r11 = 1.0f - 2.0f * (xx + zz), r12 = 2.0f * (yz + wx);
+		const float r20 = 2.0f * (xz + wy), r21 = 2.0f * (yz - wx), r22 = 1.0f - 2.0f * (xx + yy);
+
+		glm::mat4x3& m = out[i];
+
+		m[0] = glm::vec3(r00 * in.sx[i], r01 * in.sx[i], r02 * in.sx[i]);
+		m[1] = glm::vec3(r10 * in.sy[i], r11 * in.sy[i], r12 * in.sy[i]);
+		m[2] = glm::vec3(r20 * in.sz[i], r21 * in.sz[i], r22 * in.sz[i]);
+		/* pos + center - rotate(center) */
+		m[3] = glm::vec3(
+			in.px[i] + cx - (r00 * cx + r10 * cy + r20 * cz),
+			in.py[i] + cy - (r01 * cx + r11 * cy + r21 * cz),
+			in.pz[i] + cz - (r02 * cx + r12 * cy + r22 * cz)
+		);
+	}
+}
+
+
+static void normalsScalar(const glm::mat4x3* in, size_t begin, size_t end, glm::mat3* out) {
+	for (size_t i = begin; i < end; i++) {
+		const glm::vec3 c0 = in[i][0], c1 = in[i][1], c2 = in[i][2];
+
+		/* the rows of the inverse times the determinant */
+		const glm::vec3 n0 = glm::cross(c1, c2);
+		const glm::vec3 n1 = glm::cross(c2, c0);
+		const glm::vec3 n2 = glm::cross(c0, c1);
+		const float invDet = 1.0f / glm::dot(c0, n0);
+
+		out[i] = glm::mat3(n0 * invDet, n1 * invDet, n2 * invDet);
+	}
+}
+
+
+#if TRANSFORM_KERNEL_X86
+
+/////////////////////////////////////////////////////////////////////////////////////////
+/*      SSE                                                                            */
+/////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+	A 3x4 matrix is 12 consecutive floats, a, b, c and d hold floats 4 * quarter up to
+	4 * quarter + 3 of four matrices and are transposed to four floats per matrix.
+*/
+static inline void storeQuarterSSE(__m128 a, __m128 b, __m128 c, __m128 d, glm::mat4x3* out, int quarter) {
+	_MM_TRANSPOSE4_PS(a, b, c, d);
+
+	_mm_storeu_ps(glm::value_ptr(out[0]) + 4 * quarter, a);
+	_mm_storeu_ps(glm::value_ptr(out[1]) + 4 * quarter, b);
+	_mm_storeu_ps(glm::value_ptr(out[2]) + 4 * quarter, c);
+	_mm_storeu_ps(glm::value_ptr(out[3]) + 4 * quarter, d);
+}
+
+static void composeSSE(const transformKernel::input& in, size_t count, glm::mat4x3* out) {
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 x = _mm_loadu_ps(in.qx + i), y = _mm_loadu_ps(in.qy + i), z = _mm_loadu_ps(in.qz + i), w = _mm_loadu_ps(in.qw + i);
+		const __m128 cx = _mm_loadu_ps(in.cx + i), cy = _mm_loadu_ps(in.cy + i), cz = _mm_loadu_ps(in.cz + i);
+		const __m128 sx = _mm_loadu_ps(in.sx + i), sy = _mm_loadu_ps(in.sy + i), sz = _mm_loadu_ps(in.sz + i);
+
+		const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		const __m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		const __m128 r01 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+		const __m128 r02 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+		const __m128 r10 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+		const __m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		const __m128 r12 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+		const __m128 r20 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+		const __m128 r21 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+		const __m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+		const __m128 tx = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(in.px + i), cx),
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, cx), _mm_mul_ps(r10, cy)), _mm_mul_ps(r20, cz)));
+		const __m128 ty = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(in.py + i), cy),
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(r01, cx), _mm_mul_ps(r11, cy)), _mm_mul_ps(r21, cz)));
+		const __m128 tz = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(in.pz + i), cz),
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(r02, cx), _mm_mul_ps(r12, cy)), _mm_mul_ps(r22, cz)));
+
+		storeQuarterSSE(_mm_mul_ps(r00, sx), _mm_mul_ps(r01, sx), _mm_mul_ps(r02, sx), _mm_mul_ps(r10, sy), out + i, 0);
+		storeQuarterSSE(_mm_mul_ps(r11, sy), _mm_mul_ps(r12, sy), _mm_mul_ps(r20, sz), _mm_mul_ps(r21, sz), out + i, 1);
+		storeQuarterSSE(_mm_mul_ps(r22, sz), tx, ty, tz, out + i, 2);
+	}
+
+	composeScalar(in, i, count, out);
+}
+
+static inline __m128 crossComponentSSE(__m128 ay, __m128 az, __m128 by, __m128 bz) {
+	return _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+}
+
+static void normalsSSE(const glm::mat4x3* in, size_t count, glm::mat3* out) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		/* the first 12 floats of four matrices, transposed to one float of four matrices per register */
+		__m128 a0 = _mm_loadu_ps(glm::value_ptr(in[i + 0])), a1 = _mm_loadu_ps(glm::value_ptr(in[i + 1]));
+		__m128 a2 = _mm_loadu_ps(glm::value_ptr(in[i + 2])), a3 = _mm_loadu_ps(glm::value_ptr(in[i + 3]));
+		__m128 b0 = _mm_loadu_ps(glm::value_ptr(in[i + 0]) + 4), b1 = _mm_loadu_ps(glm::value_ptr(in[i + 1]) + 4);
+		__m128 b2 = _mm_loadu_ps(glm::value_ptr(in[i + 2]) + 4), b3 = _mm_loadu_ps(glm::value_ptr(in[i + 3]) + 4);
+		__m128 z0 = _mm_load_ss(glm::value_ptr(in[i + 0]) + 8), z1 = _mm_load_ss(glm::value_ptr(in[i + 1]) + 8);
+		__m128 z2 = _mm_load_ss(glm::value_ptr(in[i + 2]) + 8), z3 = _mm_load_ss(glm::value_ptr(in[i + 3]) + 8);
+		_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+		_MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+		_MM_TRANSPOSE4_PS(z0, z1, z2, z3);
+
+		const __m128 c0x = a0, c0y = a1, c0z = a2;
+		const __m128 c1x = a3, c1y = b0, c1z = b1;
+		const __m128 c2x = b2, c2y = b3, c2z = z0;
+
+		const __m128 n0x = crossComponentSSE(c1y, c1z, c2y, c2z), n0y = crossComponentSSE(c1z, c1x, c2z, c2x), n0z = crossComponentSSE(c1x, c1y, c2x, c2y);
+		const __m128 n1x = crossComponentSSE(c2y, c2z, c0y, c0z), n1y = crossComponentSSE(c2z, c2x, c0z, c0x), n1z = crossComponentSSE(c2x, c2y, c0x, c0y);
+		const __m128 n2x = crossComponentSSE(c0y, c0z, c1y, c1z), n2y = crossComponentSSE(c0z, c0x, c1z, c1x), n2z = crossComponentSSE(c0x, c0y, c1x, c1y);
+
+		const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0x, n0x), _mm_mul_ps(c0y, n0y)), _mm_mul_ps(c0z, n0z));
+		const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+		/* a mat3 is 9 floats, so the results go through memory instead of transposes */
+		alignas(16) float result[9][4];
+		_mm_store_ps(result[0], _mm_mul_ps(n0x, invDet));
+		_mm_store_ps(result[1], _mm_mul_ps(n0y, invDet));
+		_mm_store_ps(result[2], _mm_mul_ps(n0z, invDet));
+		_mm_store_ps(result[3], _mm_mul_ps(n1x, invDet));
+		_mm_store_ps(result[4], _mm_mul_ps(n1y, invDet));
+		_mm_store_ps(result[5], _mm_mul_ps(n1z, invDet));
+		_mm_store_ps(result[6], _mm_mul_ps(n2x, invDet));
+		_mm_store_ps(result[7], _mm_mul_ps(n2y, invDet));
+		_mm_store_ps(result[8], _mm_mul_ps(n2z, invDet));
+
+		for (int lane = 0; lane < 4; lane++) {
+			float* m = glm::value_ptr(out[i + lane]);
+			for (int f = 0; f < 9; f++) m[f] = result[f][lane];
+		}
+	}
+
+	normalsScalar(in, i, count, out);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////
+/*      AVX2                                                                           */
+/////////////////////////////////////////////////////////////////////////////////////////
+
+TARGET_AVX2 static inline void storeQuarterAVX(__m256 a, __m256 b, __m256 c, __m256 d, glm::mat4x3* out, int quarter) {
+	storeQuarterSSE(_mm256_castps256_ps128(a), _mm256_castps256_ps128(b), _mm256_castps256_ps128(c), _mm256_castps256_ps128(d), out, quarter);
+	storeQuarterSSE(_mm256_extractf128_ps(a, 1), _mm256_extractf128_ps(b, 1), _mm256_extractf128_ps(c, 1), _mm256_extractf128_ps(d, 1), out + 4, quarter);
+}
+
+TARGET_AVX2 static void composeAVX2(const transformKernel::input& in, size_t count, glm::mat4x3* out) {
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 two = _mm256_set1_ps(2.0f);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 x = _mm256_loadu_ps(in.qx + i), y = _mm256_loadu_ps(in.qy + i), z = _mm256_loadu_ps(in.qz + i), w = _mm256_loadu_ps(in.qw + i);
+		const __m256 cx = _mm256_loadu_ps(in.cx + i), cy = _mm256_loadu_ps(in.cy + i), cz = _mm256_loadu_ps(in.cz + i);
+		const __m256 sx = _mm256_loadu_ps(in.sx + i), sy = _mm256_loadu_ps(in.sy + i), sz = _mm256_loadu_ps(in.sz + i);
+
+		const __m256 x2 = _mm256_mul_ps(two, x), y2 = _mm256_mul_ps(two, y), z2 = _mm256_mul_ps(two, z);
+
+		/* 2xx, 2xy, ... */
+		const __m256 xx = _mm256_mul_ps(x2, x), yy = _mm256_mul_ps(y2, y), zz = _mm256_mul_ps(z2, z);
+		const __m256 xy = _mm256_mul_ps(x2, y), xz = _mm256_mul_ps(x2, z), yz = _mm256_mul_ps(y2, z);
+		const __m256 wx = _mm256_mul_ps(x2, w), wy = _mm256_mul_ps(y2, w), wz = _mm256_mul_ps(z2, w);
+
+		const __m256 r00 = _mm256_sub_ps(one, _mm256_add_ps(yy, zz));
+		const __m256 r01 = _mm256_add_ps(xy, wz);
+		const __m256 r02 = _mm256_sub_ps(xz, wy);
+		const __m256 r10 = _mm256_sub_ps(xy, wz);
+		const __m256 r11 = _mm256_sub_ps(one, _mm256_add_ps(xx, zz));
+		const __m256 r12 = _mm256_add_ps(yz, wx);
+		const __m256 r20 = _mm256_add_ps(xz, wy);
+		const __m256 r21 = _mm256_sub_ps(yz, wx);
+		const __m256 r22 = _mm256_sub_ps(one, _mm256_add_ps(xx, yy));
+
+		/* the same operations in the same order as composeScalar, so every lane rounds like the remainder */
+		const __m256 tx = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(in.px + i), cx),
+			_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r00, cx), _mm256_mul_ps(r10, cy)), _mm256_mul_ps(r20, cz)));
+		const __m256 ty = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(in.py + i), cy),
+			_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r01, cx), _mm256_mul_ps(r11, cy)), _mm256_mul_ps(r21, cz)));
+		const __m256 tz = _mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(in.pz + i), cz),
+			_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r02, cx), _mm256_mul_ps(r12, cy)), _mm256_mul_ps(r22, cz)));
+
+		storeQuarterAVX(_mm256_mul_ps(r00, sx), _mm256_mul_ps(r01, sx), _mm256_mul_ps(r02, sx), _mm256_mul_ps(r10, sy), out + i, 0);
+		storeQuarterAVX(_mm256_mul_ps(r11, sy), _mm256_mul_ps(r12, sy), _mm256_mul_ps(r20, sz), _mm256_mul_ps(r21, sz), out + i, 1);
+		storeQuarterAVX(_mm256_mul_ps(r22, sz), tx, ty, tz, out + i, 2);
+	}
+
+	composeScalar(in, i, count, out);
+}
+
+#endif
+
+
+/////////////////////////////////////////////////////////////////////////////////////////
+/*      DISPATCH                                                                       */
+/////////////////////////////////////////////////////////////////////////////////////////
+
+transformKernel::implementation transformKernel::detectImplementation() {
+#if TRANSFORM_KERNEL_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	const bool osxsave = info[2] & (1 << 27);
+	const bool avx = info[2] & (1 << 28);
+
+	bool avx2 = false;
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = info[1] & (1 << 5);
+	}
+
+	/* the OS has to save the ymm registers */
+	const bool osAvx = osxsave && (_xgetbv(0) & 0x6) == 0x6;
+
+	if (avx && avx2 && osAvx) return implementation::AVX2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return implementation::AVX2;
+#endif
+	return implementation::SSE;
+#else
+	return implementation::Scalar;
+#endif
+}
+
+const char* transformKernel::implementationName(implementation impl) {
+	switch (impl) {
+	case implementation::Scalar:
+		return "scalar";
+	case implementation::SSE:
+		return "SSE";
+	case implementation::AVX2:
+		return "AVX2";
+	default:
+		return "unknown";
+	}
+}
+
+void transformKernel::compose(const input& in, size_t count, glm::mat4x3* out) {
+	static const implementation impl = detectImplementation();
+	compose(impl, in, count, out);
+}
+
+void transformKernel::compose(implementation impl, const input& in, size_t count, glm::mat4x3* out) {
+	switch (impl) {
+#if TRANSFORM_KERNEL_X86
+	case implementation::AVX2:
+		composeAVX2(in, count, out);
+		break;
+	case implementation::SSE:
+		composeSSE(in, count, out);
+		break;
+#endif
+	default:
+		composeScalar(in, 0, count, out);
+		break;
+	}
+}
+
+void transformKernel::normalMatrices(const glm::mat4x3* in, size_t count, glm::mat3* out) {
+	static const implementation impl = detectImplementation();
+	normalMatrices(impl, in, count, out);
+}
+
+void transformKernel::normalMatrices(implementation impl, const glm::mat4x3* in, size_t count, glm::mat3* out) {
+	switch (impl) {
+#if TRANSFORM_KERNEL_X86
+	/* 9 outputs of 4 inputs each, AVX2 doesn't pay for the wider transposes */
+	case implementation::AVX2:
+	case implementation::SSE:
+		normalsSSE(in, count, out);
+		break;
+#endif
+	default:
+		normalsScalar(in, 0, count, out);
+		break;
+	}
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////
+/*      BENCHMARK                                                                      */
+/////////////////////////////////////////////////////////////////////////////////////////
+
+void transformKernel::benchmark(size_t count, int iterations) {
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+	std::vector<float> data(13 * count);
+	for (size_t i = 0; i < count; i++) {
+		glm::quat q = glm::normalize(glm::quat(dist(rng), dist(rng), dist(rng), dist(rng)));
+		data[3 * count + i] = q.x;
+		data[4 * count + i] = q.y;
+		data[5 * count + i] = q.z;
+		data[6 * count + i] = q.w;
+	}
+	for (size_t i = 0; i < 3 * count; i++) {
+		data[i] = 10.0f * dist(rng);
+		data[7 * count + i] = dist(rng);
+		data[10 * count + i] = 1.0f + 0.5f * dist(rng);
+	}
+
+	const float* d = data.data();
+	const input in = {
+		d, d + count, d + 2 * count,
+		d + 3 * count, d + 4 * count, d + 5 * count, d + 6 * count,
+		d + 7 * count, d + 8 * count, d + 9 * count,
+		d + 10 * count, d + 11 * count, d + 12 * count
+	};
+
+	std::vector<glm::mat4> reference(count);
+	std::vector<glm::mat4x3> result(count);
+	std::vector<glm::mat4x3> scalar(count);
+	compose(implementation::Scalar, in, count, scalar.data());
+
+	auto time = [iterations](auto&& func) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) func();
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+	};
+
+	/* the path calcTransforms used before this kernel */
+	double glmTime = time([&] {
+		for (size_t i = 0; i < count; i++) {
+			const glm::vec3 pos(in.px[i], in.py[i], in.pz[i]);
+			const glm::vec3 center(in.cx[i], in.cy[i], in.cz[i]);
+			const glm::quat orient(in.qw[i], in.qx[i], in.qy[i], in.qz[i]);
+			const glm::vec3 scl(in.sx[i], in.sy[i], in.sz[i]);
+
+			reference[i] =
+				  glm::translate(glm::mat4(1.0f), pos + center)
+				* glm::mat4_cast(orient)
+				* glm::translate(glm::mat4(1.0f), -center)
+				* glm::scale(glm::mat4(1.0f), scl);
+		}
+	});
+
+	std::cout << "Composing " << count << " transforms, average of " << iterations << " runs:" << std::endl;
+	std::cout << "  glm: " << glmTime << " ms" << std::endl;
+
+	const implementation best = detectImplementation();
+
+	for (implementation impl : { implementation::Scalar, implementation::SSE, implementation::AVX2 }) {
+		if (impl > best) break;
+
+		double implTime = time([&] { compose(impl, in, count, result.data()); });
+
+		float maxError = 0.0f;
+		/* a matrix must not depend on the lane its entity falls in */
+		size_t mismatches = 0;
+		for (size_t i = 0; i < count; i++) {
+			for (int c = 0; c < 4; c++) {
+				maxError = std::max(maxError, glm::length(result[i][c] - glm::vec3(reference[i][c])));
+			}
+			if (result[i] != scalar[i]) mismatches++;
+		}
+
+		std::cout << "  " << implementationName(impl) << ": " << implTime << " ms ("
+			<< glmTime / implTime << "x, max error " << maxError << ", " << mismatches << " differ from scalar)" << std::endl;
+	}
+}
\ No newline at end of file
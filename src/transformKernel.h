@@ -0,0 +1,43 @@
+/*
+	Builds translate(pos + center) * rotate(orient) * translate(-center) * scale(scl)
+	affine 3x4 matrices from structure-of-arrays input, 8 (AVX2), 4 (SSE) or 1 (scalar) at a time,
+	and normal matrices of affine matrices, 4 (SSE) or 1 (scalar) at a time.
+
+	The implementation is chosen once at runtime based on what the CPU supports. All of
+	them do the same operations in the same order, so they give bit identical matrices.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+
+namespace transformKernel {
+	/* every array holds at least `count` values */
+	struct input {
+		const float* px; const float* py; const float* pz;
+		const float* qx; const float* qy; const float* qz; const float* qw;
+		const float* cx; const float* cy; const float* cz;
+		const float* sx; const float* sy; const float* sz;
+	};
+
+	enum class implementation {
+		Scalar, SSE, AVX2
+	};
+
+	implementation detectImplementation();
+	const char* implementationName(implementation impl);
+
+	/* writes count matrices to out using the best implementation the CPU supports */
+	void compose(const input& in, size_t count, glm::mat4x3* out);
+	void compose(implementation impl, const input& in, size_t count, glm::mat4x3* out);
+
+	/* the inverse transpose of the linear part of count matrices, from the cross products of its columns */
+	void normalMatrices(const glm::mat4x3* in, size_t count, glm::mat3* out);
+	void normalMatrices(implementation impl, const glm::mat4x3* in, size_t count, glm::mat3* out);
+
+	/* prints how long the glm path and every supported implementation take */
+	void benchmark(size_t count, int iterations);
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "uniformBuffers.h"
+
+#include "glDebug.h"
+
+
+UniformBuffers::UniformBuffers() {
+	cameraUbo = createBuffer(sizeof(cameraBlock), CAMERA_UBO_BINDING);
+	dirLightsUbo = createBuffer(sizeof(dirLightsBlock), DIR_LIGHTS_UBO_BINDING);
+	shadowsUbo = createBuffer(sizeof(shadowsBlock), SHADOWS_UBO_BINDING);
+	clustersUbo = createBuffer(sizeof(clustersBlock), CLUSTERS_UBO_BINDING);
+}
+
+UniformBuffers::~UniformBuffers() {
+	glDeleteBuffers(1, &cameraUbo);
+	glDeleteBuffers(1, &dirLightsUbo);
+	glDeleteBuffers(1, &shadowsUbo);
+	glDeleteBuffers(1, &clustersUbo);
+}
+
+GLuint UniformBuffers::createBuffer(GLsizeiptr size, GLuint binding) {
+	GLuint ubo;
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	/* the buffers never move, so they stay bound for the whole run */
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+
+	return ubo;
+}
+
+void UniformBuffers::UploadCamera(const cameraBlock& camera) {
+	glBindBuffer(GL_UNIFORM_BUFFER, cameraUbo);
+	GL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(cameraBlock), &camera));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffers::UploadDirLights(const dirLightsBlock& dirLights) {
+	glBindBuffer(GL_UNIFORM_BUFFER, dirLightsUbo);
+	GL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(dirLightsBlock), &dirLights));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffers::UploadShadows(const shadowsBlock& shadows) {
+	glBindBuffer(GL_UNIFORM_BUFFER, shadowsUbo);
+	GL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(shadowsBlock), &shadows));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffers::UploadClusters(const clustersBlock& clusters) {
+	glBindBuffer(GL_UNIFORM_BUFFER, clustersUbo);
+	GL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(clustersBlock), &clusters));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffers::BindBlocks(GLuint program) {
+	/* GL 4.1 has no layout(binding) for blocks */
+	GLuint cameraIndex = glGetUniformBlockIndex(program, "Camera");
+	if (cameraIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, cameraIndex, CAMERA_UBO_BINDING);
+	}
+
+	GLuint dirLightsIndex = glGetUniformBlockIndex(program, "DirLights");
+	if (dirLightsIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, dirLightsIndex, DIR_LIGHTS_UBO_BINDING);
+	}
+
+	GLuint objectIndex = glGetUniformBlockIndex(program, "Object");
+	if (objectIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, objectIndex, OBJECT_UBO_BINDING);
+	}
+
+	GLuint materialIndex = glGetUniformBlockIndex(program, "Material");
+	if (materialIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, materialIndex, MATERIAL_UBO_BINDING);
+	}
+
+	GLuint shadowsIndex = glGetUniformBlockIndex(program, "Shadows");
+	if (shadowsIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, shadowsIndex, SHADOWS_UBO_BINDING);
+	}
+
+	GLuint clustersIndex = glGetUniformBlockIndex(program, "Clusters");
+	if (clustersIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, clustersIndex, CLUSTERS_UBO_BINDING);
+	}
+}
\ No newline at end of file
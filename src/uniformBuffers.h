@@ -0,0 +1,127 @@
+/*
+	Uniform buffers with the data every program shares, written once per frame.
+
+	The structs match the std140 blocks in the shaders, every block is bound to its own
+	fixed binding point and BindBlocks connects a linked program to them. The per draw
+	blocks live in the render queue's stream buffer and are bound by offset.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+
+/* keep in sync with the shaders */
+constexpr GLuint CAMERA_UBO_BINDING = 0;
+constexpr GLuint DIR_LIGHTS_UBO_BINDING = 1;
+constexpr GLuint OBJECT_UBO_BINDING = 2;
+constexpr GLuint MATERIAL_UBO_BINDING = 3;
+constexpr GLuint SHADOWS_UBO_BINDING = 4;
+constexpr GLuint CLUSTERS_UBO_BINDING = 5;
+constexpr GLuint SHADOW_TEXTURE_UNIT = 0;
+/* the texture buffers of the clustered lights */
+constexpr GLuint LIGHT_DATA_TEXTURE_UNIT = 1;
+constexpr GLuint CLUSTER_GRID_TEXTURE_UNIT = 2;
+constexpr GLuint LIGHT_INDICES_TEXTURE_UNIT = 3;
+constexpr uint32_t MAX_DIR_LIGHTS = 10;
+/* the splits and the offsets of the cascades are packed into vec4s */
+constexpr uint32_t SHADOW_CASCADES = 4;
+
+/* layout(std140) uniform Camera */
+struct cameraBlock {
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::mat4 viewProj;
+};
+
+/* std140 pads every vec3 to 16 bytes */
+struct dirLightBlock {
+	/* in view space */
+	glm::vec4 dir;
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+};
+
+/* layout(std140) uniform DirLights */
+struct dirLightsBlock {
+	dirLightBlock lights[MAX_DIR_LIGHTS];
+	uint32_t count;
+	uint32_t padding[3];
+};
+
+/* layout(std140) uniform Object, every matrix column is padded to a vec4 */
+struct objectBlock {
+	glm::vec4 model[4];
+	glm::vec4 normal[3];
+};
+
+/* layout(std140) uniform Material, shininess fills the padding after specular */
+struct materialBlock {
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec3 specular;
+	float shininess;
+};
+
+/* layout(std140) uniform Shadows, the first directional light casts them */
+struct shadowsBlock {
+	/* from view space to the [0, 1] texture coordinates and depth of each cascade */
+	glm::mat4 cascades[SHADOW_CASCADES];
+	/* the view space depth each cascade ends at */
+	glm::vec4 splits;
+	/* how far along the normal the lookups move, a texel or so of each cascade */
+	glm::vec4 normalOffsets;
+	/* 0 turns the shadows off */
+	uint32_t count;
+	uint32_t padding[3];
+};
+
+/* layout(std140) uniform Clusters, the lights themselves are in texture buffers */
+struct clustersBlock {
+	/* the froxels across the screen and along the depth */
+	uint32_t gridX;
+	uint32_t gridY;
+	uint32_t gridZ;
+	/* point and spot lights in the light data */
+	uint32_t lightCount;
+	/* the depth slice of a view space depth d is floor(log(d) * sliceScale + sliceBias) */
+	float sliceScale;
+	float sliceBias;
+	float padding[2];
+};
+
+static_assert(sizeof(cameraBlock) == 192, "cameraBlock doesn't match the std140 layout");
+static_assert(sizeof(dirLightsBlock) == 16 * (4 * MAX_DIR_LIGHTS + 1), "dirLightsBlock doesn't match the std140 layout");
+static_assert(sizeof(objectBlock) == 112, "objectBlock doesn't match the std140 layout");
+static_assert(sizeof(materialBlock) == 48, "materialBlock doesn't match the std140 layout");
+static_assert(sizeof(shadowsBlock) == 64 * SHADOW_CASCADES + 48, "shadowsBlock doesn't match the std140 layout");
+static_assert(sizeof(clustersBlock) == 32, "clustersBlock doesn't match the std140 layout");
+
+class UniformBuffers {
+private:
+	GLuint cameraUbo;
+	GLuint dirLightsUbo;
+	GLuint shadowsUbo;
+	GLuint clustersUbo;
+
+	static GLuint createBuffer(GLsizeiptr size, GLuint binding);
+
+public:
+	UniformBuffers();
+	~UniformBuffers();
+
+	UniformBuffers(const UniformBuffers&) = delete;
+	UniformBuffers& operator=(const UniformBuffers&) = delete;
+
+	void UploadCamera(const cameraBlock& camera);
+	void UploadDirLights(const dirLightsBlock& dirLights);
+	void UploadShadows(const shadowsBlock& shadows);
+	void UploadClusters(const clustersBlock& clusters);
+
+	/* connects the blocks the program uses to their binding points */
+	static void BindBlocks(GLuint program);
+};
\ No newline at end of file